@@ -2,7 +2,7 @@
 
 AutoFile::AutoFile(AutoFile&& Another) noexcept : File(exchange(Another.File, nullptr)) {}
 
-AutoFile::AutoFile(const char* Path, const char* Mode) noexcept {
+AutoFile::AutoFile(const char* Path, const char* Mode) {
   Open(Path, Mode);
 }
 
@@ -20,7 +20,8 @@ void AutoFile::Swap(AutoFile& Another) noexcept {
   swap(File, Another.File);
 }
 
-void AutoFile::Open(const char* Path, const char* Mode) noexcept {
+void AutoFile::Open(const char* Path, const char* Mode) {
+  Close();
   File = fopen(Path, Mode);
   if (!File)
     Abort("Failed to open %s as [%s]", Path, Mode);
@@ -55,7 +56,7 @@ void AutoFile::Advance(ptrdiff_t Off) {
     Abort("Failed to advance for %zd bytes", Off);
 }
 
-string AutoFile::ReadAll() noexcept {
+string AutoFile::ReadAll() {
   auto NByte = Size();
   fseek(File, 0, SEEK_SET);
   string Res(NByte, '\0');
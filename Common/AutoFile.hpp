@@ -7,7 +7,7 @@ public:
   constexpr AutoFile() noexcept = default;
   AutoFile(const AutoFile&) = delete;
   AutoFile(AutoFile&& Another) noexcept;
-  AutoFile(const char* Path, const char* Mode) noexcept;
+  AutoFile(const char* Path, const char* Mode);
   ~AutoFile();
 
   AutoFile& operator =(const AutoFile&) = delete;
@@ -17,7 +17,8 @@ public:
 
   constexpr FILE* Raw() noexcept { return File; }
 
-  void Open(const char* Path, const char* Mode) noexcept;
+  // The file open before, if any, is closed first
+  void Open(const char* Path, const char* Mode);
   void Close() noexcept;
   size_t Size() noexcept;
 
@@ -26,46 +27,46 @@ public:
   void Advance(ptrdiff_t Off);
 
   template<class T>
-  T Get() noexcept {
+  T Get() {
     T Res;
     Get(&Res, 1);
     return Res;
   }
 
   template<class T>
-  void Put(const T& Obj) noexcept {
+  void Put(const T& Obj) {
     Put(&Obj, 1);
   }
 
   template<class T>
-  T GetAt(size_t Offset) noexcept {
+  T GetAt(size_t Offset) {
     T Res;
     GetAt(&Res, Offset, 1);
     return Res;
   }
 
   template<class T>
-  void PutAt(const T& Obj, size_t Offset) noexcept {
+  void PutAt(const T& Obj, size_t Offset) {
     PutAt(&Obj, Offset, 1);
   }
 
 
   template<class T>
-  void Get(T* Ptr, size_t Count) noexcept {
+  void Get(T* Ptr, size_t Count) {
     auto Size = sizeof(T) * Count;
     if (Size != fread(Ptr, 1, Size, File))
       Abort("Failed to read %zu bytes\n", Size);
   }
 
   template<class T>
-  void Put(const T* Ptr, size_t Count) noexcept {
+  void Put(const T* Ptr, size_t Count) {
     auto Size = sizeof(T) * Count;
     if (Size != fwrite(Ptr, 1, Size, File))
       Abort("Failed to write %zu bytes\n", Size);
   }
 
   template<class T>
-  void GetAt(T* Ptr, size_t Offset, size_t Count) noexcept {
+  void GetAt(T* Ptr, size_t Offset, size_t Count) {
     if (fseek(File, (long) Offset, SEEK_SET))
       Abort("Failed to set the file pointer to %zu bytes\n", Offset);
     auto Size = sizeof(T) * Count;
@@ -74,7 +75,7 @@ public:
   }
 
   template<class T>
-  void PutAt(const T* Ptr, size_t Offset, size_t Count) noexcept {
+  void PutAt(const T* Ptr, size_t Offset, size_t Count) {
     if (fseek(File, (long) Offset, SEEK_SET))
       Abort("Failed to set the file pointer to %zu bytes\n", Offset);
     auto Size = sizeof(T) * Count;
@@ -82,7 +83,7 @@ public:
       Abort("Failed to write %zu bytes at %zu bytes\n", Size, Offset);
   }
 
-  string ReadAll() noexcept;
+  string ReadAll();
 private:
   FILE* File = nullptr;
 };
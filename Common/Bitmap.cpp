@@ -1,7 +1,6 @@
 #include "AutoFile.hpp"
 #include "Bitmap.hpp"
-
-#include <png.h>
+#include "Diag.hpp"
 
 namespace {
   constexpr uint32_t Dis2(uint32_t A, uint32_t B) {
@@ -13,77 +12,111 @@ namespace {
     return Dis2(A.R, B.R) + Dis2(A.G, B.G) + Dis2(A.B, B.B);
   }
 
-#ifdef BMP_ALPHA
-  constexpr Pixel AlphaBlend(const Pixel& Src, const Pixel& Dst) {
+  constexpr PixelA AlphaBlend(const PixelA& Src, const PixelA& Dst) {
     auto Sx = Src.A * 255u;
     auto Dx = Dst.A * (255u - Src.A);
     auto Ax = Sx + Dx;
     if (!Ax)
-      return {};
+      return {0, 0, 0, 0};
     auto R = (uint8_t) ((Sx * Src.R + Dx * Dst.R) / Ax);
     auto G = (uint8_t) ((Sx * Src.G + Dx * Dst.G) / Ax);
     auto B = (uint8_t) ((Sx * Src.B + Dx * Dst.B) / Ax);
     auto A = (uint8_t) (Ax / 255);
     return {R, G, B, A};
   }
-#endif
 }
 
-void Bitmap::SavePng(const char* Path) {
-  auto File = AutoFile(Path, "wb");
-  auto Png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-  if (!Png)
-    Abort("Failed to create png write struct");
-  auto Info = png_create_info_struct(Png);
-  if (!Info)
-    Abort("Failed to create png info struct");
-  if (setjmp(png_jmpbuf(Png)))
-    Abort("Failed to write png");
-  png_set_IHDR(Png, Info, (uint32_t) Width(), (uint32_t) Height(), 8,
-#ifdef BMP_ALPHA
-    PNG_COLOR_TYPE_RGBA,
-#else
-    PNG_COLOR_TYPE_RGB,
-#endif
-    PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-  vector<png_byte*> Rows(Height());
-  for (auto y = 0u; y < Height(); ++y)
-    Rows[y] = (png_byte*) (*this)[y];
-  png_init_io(Png, File.Raw());
-  png_set_rows(Png, Info, Rows.data());
-  png_write_png(Png, Info, PNG_TRANSFORM_IDENTITY, nullptr);
-  png_destroy_write_struct(&Png, &Info);
+namespace {
+  template<class Pix>
+  void DrawView(BitmapView<Pix> Dst, BitmapView<const Pix> Src, int32_t X, int32_t Y, uint32_t Mask) {
+    auto XD = X < 0 ? 0 : X;
+    auto YD = Y < 0 ? 0 : Y;
+    auto XS = X < 0 ? -X : 0;
+    auto YS = Y < 0 ? -Y : 0;
+    auto W = min((int32_t) Dst.Width() - XD, (int32_t) Src.Width() - XS);
+    auto H = min((int32_t) Dst.Height() - YD, (int32_t) Src.Height() - YS);
+    if (W <= 0 || H <= 0) {
+      Diags().Add(DiagKind::NotDrawn);
+      return;
+    }
+    if (W != Src.Width() || H != Src.Height())
+      Diags().Add(DiagKind::Cropped);
+    for (auto y = 0; y < H; ++y) {
+      auto S = Src[y + YS] + XS;
+      auto D = Dst[y + YD] + XD;
+      if constexpr (is_same_v<Pix, PixelA>) {
+        (void) Mask;
+        for (auto x = 0; x < W; ++x)
+          D[x] = AlphaBlend(S[x], D[x]);
+      }
+      else if constexpr (is_same_v<Pix, PixelI>) {
+        (void) Mask;
+        for (auto x = 0; x < W; ++x)
+          if (S[x].Opq)
+            D[x] = S[x];
+      }
+      else {
+        for (auto x = 0; x < W; ++x)
+          if (S[x].Rgb() != Mask)
+            D[x] = S[x];
+      }
+    }
+  }
+}
+
+void Draw(BitmapView<Pixel> Dst, BitmapView<const Pixel> Src, int32_t X, int32_t Y, uint32_t Mask) {
+  DrawView(Dst, Src, X, Y, Mask);
 }
 
-#ifdef BMP_ALPHA
-void Bitmap::Draw(const Bitmap& Bmp, int32_t X, int32_t Y) {
-#else
-void Bitmap::Draw(const Bitmap& Bmp, int32_t X, int32_t Y, uint32_t Mask) {
-#endif
+void Draw(BitmapView<PixelA> Dst, BitmapView<const PixelA> Src, int32_t X, int32_t Y) {
+  DrawView(Dst, Src, X, Y, 0);
+}
+
+void Draw(BitmapView<PixelI> Dst, BitmapView<const PixelI> Src, int32_t X, int32_t Y) {
+  DrawView(Dst, Src, X, Y, 0);
+}
+
+void Draw(BitmapView<uint8_t> Dst, BitmapView<const uint8_t> Src, int32_t X, int32_t Y, Diagnostics& Diag,
+  uint32_t Ch) {
   auto XD = X < 0 ? 0 : X;
   auto YD = Y < 0 ? 0 : Y;
   auto XS = X < 0 ? -X : 0;
   auto YS = Y < 0 ? -Y : 0;
-  auto W = min((int32_t) Width() - XD, (int32_t) Bmp.Width() - XS);
-  auto H = min((int32_t) Height() - YD, (int32_t) Bmp.Height() - YS);
+  auto W = min((int32_t) Dst.Width() - XD, (int32_t) Src.Width() - XS);
+  auto H = min((int32_t) Dst.Height() - YD, (int32_t) Src.Height() - YS);
   if (W <= 0 || H <= 0) {
-    Warn("No bitmap is drawn at (%d,%d)->(%d,%d); canvas size is ($zux%zu)",
-      X, Y, X + (int32_t) Bmp.Width(), Y + (int32_t) Bmp.Width(), Width(), Height());
+    Diag.Add(DiagKind::NotDrawn, Ch);
     return;
   }
-  if (W != Bmp.Width() || H != Bmp.Height())
-    Warn("Bitmap is cropped from (%zu,%zu) to (%d,%d)", Bmp.Width(), Bmp.Height(), W, H);
-  for (auto y = 0; y < H; ++y)
-    for (auto x = 0; x < W; ++x) {
-#ifdef BMP_ALPHA
-      (*this)[y + Y][x + X] = AlphaBlend(Bmp[y][x], (*this)[y + Y][x + X]);
-#else
-      if (Bmp[y + YS][x + XS].Rgb() != Mask)
-        (*this)[y + YD][x + XD] = Bmp[y + YS][x + XS];
-#endif
-    }
+  if (W != Src.Width() || H != Src.Height())
+    Diag.Add(DiagKind::Cropped, Ch);
+  for (auto y = 0; y < H; ++y) {
+    auto S = Src[y + YS] + XS;
+    auto D = Dst[y + YD] + XD;
+    for (auto x = 0; x < W; ++x)
+      if (S[x])
+        D[x] = S[x];
+  }
 }
 
+template<class Pix>
+void BasicBitmap<Pix>::Save(const char* Path, const ImgOptions& Opt) const {
+  SaveImage(Path, BitmapView<const Pix>(*this), Opt);
+}
+
+template<class Pix>
+void BasicBitmap<Pix>::Draw(BitmapView<const Pix> Bmp, int32_t X, int32_t Y, uint32_t Mask) {
+  if constexpr (HasAlpha) {
+    (void) Mask;
+    ::Draw(*this, Bmp, X, Y);
+  }
+  else
+    ::Draw(*this, Bmp, X, Y, Mask);
+}
+
+template class BasicBitmap<Pixel>;
+template class BasicBitmap<PixelA>;
+
 uint8_t Palette::Encode(const Pixel& Pix) const noexcept {
   auto Res = ~0u;
   auto MinDiff = ~0u;
@@ -103,9 +136,6 @@ void Palette::ReadDat(const char* Path) {
       (*this)[i].R = i;
       (*this)[i].G = i;
       (*this)[i].B = i;
-#ifdef BMP_ALPHA
-      (*this)[i].A = 255;
-#endif
     }
     return;
   }
@@ -119,9 +149,6 @@ void Palette::ReadDat(const char* Path) {
     (*this)[i].R = Vals[2];
     (*this)[i].G = Vals[1];
     (*this)[i].B = Vals[0];
-#ifdef BMP_ALPHA
-    (*this)[i].A = 255;
-#endif
   }
 }
 
@@ -135,3 +162,34 @@ uint8_t PalEncoder::Encode(const Pixel& Pix) noexcept {
   Map.emplace(Pix.Rgb(), Idx);
   return Idx;
 }
+
+void IdxBitmap::Draw(BitmapView<const PixelI> Bmp, int32_t X, int32_t Y) {
+  ::Draw(*this, Bmp, X, Y);
+}
+
+BitmapA IdxBitmap::ToBitmap(const Palette& Pal) const {
+  BitmapA Bmp(Width(), Height());
+  auto Src = Raw();
+  auto Dst = Bmp.Raw();
+  for (auto i = size_t{0}; i < Count(); ++i)
+    Dst[i] = Src[i].Opq ? PixelA(Pal[Src[i].Idx]) : PixelA(0, 0, 0, 0);
+  return Bmp;
+}
+
+void IdxBitmap::Save(const char* Path, const Palette& Pal, const ImgOptions& Opt) const {
+  array<bool, 256> Used{};
+  auto Src = Raw();
+  for (auto i = size_t{0}; i < Count(); ++i)
+    if (Src[i].Opq)
+      Used[Src[i].Idx] = true;
+  auto Key = (int32_t) (find(Used.begin(), Used.end(), false) - Used.begin());
+  if (Key == 256) {
+    Warn("All 256 colors are used by %s, its transparent pixels take color 0", Path);
+    Key = -1;
+  }
+  vector<uint8_t> Idx(Count());
+  for (auto i = size_t{0}; i < Count(); ++i)
+    Idx[i] = Src[i].Opq ? Src[i].Idx : (uint8_t) max(Key, 0);
+  SaveIndexed(Path, BitmapView<const uint8_t>(Idx.data(), Width(), Height(), (ptrdiff_t) Width()),
+    (const uint8_t*) Pal.data(), Key, Opt);
+}
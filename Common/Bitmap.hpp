@@ -1,30 +1,55 @@
 #pragma once
 
 #include "Common.hpp"
+#include "Diag.hpp"
+#include "Image.hpp"
 #include "RcArray.hpp"
 
+// Opaque color, masked bitmaps take one color (the mask) as transparent
 struct Pixel {
   uint8_t R;
   uint8_t G;
   uint8_t B;
-#ifdef BMP_ALPHA
-  uint8_t A;
-#endif
 
   Pixel() noexcept = default;
   constexpr Pixel(uint8_t R_, uint8_t G_, uint8_t B_) noexcept :
     R(R_), G(G_), B(B_) {}
-  constexpr Pixel(uint32_t Val) : R((uint8_t) (Val >> 16)), G((uint8_t) (Val >> 8)), B((uint8_t) Val)
-#ifdef BMP_ALPHA
-    , A((uint8_t) (Val >> 24))
-#endif
-  {}
+  constexpr Pixel(uint32_t Val) : R((uint8_t) (Val >> 16)), G((uint8_t) (Val >> 8)), B((uint8_t) Val) {}
 
   constexpr uint32_t Rgb() const noexcept {
     return (uint32_t) R << 16 | (uint32_t) G << 8 | B;
   }
 };
 
+// Color with straight alpha, 0 being transparent
+struct PixelA {
+  uint8_t R;
+  uint8_t G;
+  uint8_t B;
+  uint8_t A;
+
+  PixelA() noexcept = default;
+  constexpr PixelA(uint8_t R_, uint8_t G_, uint8_t B_, uint8_t A_) noexcept :
+    R(R_), G(G_), B(B_), A(A_) {}
+  constexpr PixelA(uint32_t Val) :
+    R((uint8_t) (Val >> 16)), G((uint8_t) (Val >> 8)), B((uint8_t) Val), A((uint8_t) (Val >> 24)) {}
+  constexpr PixelA(const Pixel& Pix, uint8_t A_ = 255) noexcept :
+    R(Pix.R), G(Pix.G), B(Pix.B), A(A_) {}
+
+  constexpr uint32_t Rgb() const noexcept {
+    return (uint32_t) R << 16 | (uint32_t) G << 8 | B;
+  }
+
+  constexpr Pixel Color() const noexcept { return {R, G, B}; }
+};
+
+// Palette index as stored in DC6, where transparent pixels are not drawn at
+// all, so that every index may also be opaque
+struct PixelI {
+  uint8_t Idx;
+  uint8_t Opq; // 0: transparent
+};
+
 class Palette : public array<Pixel, 256> {
 public:
   using array::array;
@@ -43,28 +68,72 @@ private:
   unordered_map<uint32_t, uint8_t> Map;
 };
 
-class Bitmap : public RcArray<Pixel> {
+// Pix: Pixel (masked) or PixelA (alpha)
+template<class Pix>
+class BasicBitmap : public RcArray<Pix> {
+public:
+  static constexpr bool HasAlpha = is_same_v<Pix, PixelA>;
+
+  constexpr BasicBitmap() noexcept = default;
+  BasicBitmap(const BasicBitmap&) noexcept = default;
+  BasicBitmap(BasicBitmap&&) noexcept = default;
+  BasicBitmap(size_t W, size_t H) noexcept : RcArray<Pix>(H, W) {}
+
+  BasicBitmap& operator =(const BasicBitmap&) noexcept = default;
+  BasicBitmap& operator =(BasicBitmap&&) noexcept = default;
+
+  constexpr size_t Width() const noexcept { return NCol(); }
+  constexpr size_t Height() const noexcept { return NRow(); }
+
+  void Resize(size_t W, size_t H) { RcArray<Pix>::Resize(H, W); }
+
+  // Format by Opt, or by the extension of the path (PNG without one)
+  void Save(const char* Path, const ImgOptions& Opt = {}) const;
+
+  // Alpha bitmaps are blended, masked ones skip the pixels of the Mask color
+  void Draw(BitmapView<const Pix> Bmp, int32_t X, int32_t Y, uint32_t Mask = 0x000000);
+private:
+  using RcArray<Pix>::NRow;
+  using RcArray<Pix>::NCol;
+};
+
+// Draws Src at (X, Y) of the Dst window, as BasicBitmap::Draw does
+void Draw(BitmapView<Pixel> Dst, BitmapView<const Pixel> Src, int32_t X, int32_t Y, uint32_t Mask = 0x000000);
+void Draw(BitmapView<PixelA> Dst, BitmapView<const PixelA> Src, int32_t X, int32_t Y);
+// Coverage, 0 being transparent. Diag: where cropping is reported, about the
+// char Ch if given.
+void Draw(BitmapView<uint8_t> Dst, BitmapView<const uint8_t> Src, int32_t X, int32_t Y, Diagnostics& Diag = Diags(),
+  uint32_t Ch = Diagnostics::NoChar);
+void Draw(BitmapView<PixelI> Dst, BitmapView<const PixelI> Src, int32_t X, int32_t Y);
+
+using Bitmap = BasicBitmap<Pixel>;
+using BitmapA = BasicBitmap<PixelA>;
+
+extern template class BasicBitmap<Pixel>;
+extern template class BasicBitmap<PixelA>;
+
+// Frames of a DC6 as they are stored, without palette lookups
+class IdxBitmap : public RcArray<PixelI> {
 public:
-  constexpr Bitmap() noexcept = default;
-  Bitmap(const Bitmap&) noexcept = default;
-  Bitmap(Bitmap&&) noexcept = default;
-  Bitmap(size_t W, size_t H) noexcept : RcArray(H, W) {}
+  constexpr IdxBitmap() noexcept = default;
+  IdxBitmap(const IdxBitmap&) noexcept = default;
+  IdxBitmap(IdxBitmap&&) noexcept = default;
+  IdxBitmap(size_t W, size_t H) noexcept : RcArray(H, W) {}
 
-  Bitmap& operator =(const Bitmap&) noexcept = default;
-  Bitmap& operator =(Bitmap&&) noexcept = default;
+  IdxBitmap& operator =(const IdxBitmap&) noexcept = default;
+  IdxBitmap& operator =(IdxBitmap&&) noexcept = default;
 
   constexpr size_t Width() const noexcept { return NCol(); }
   constexpr size_t Height() const noexcept { return NRow(); }
 
   void Resize(size_t W, size_t H) { RcArray::Resize(H, W); }
 
-  void SavePng(const char* Path);
+  void Draw(BitmapView<const PixelI> Bmp, int32_t X, int32_t Y);
 
-#ifdef BMP_ALPHA
-  void Draw(const Bitmap& Bmp, int32_t X, int32_t Y);
-#else
-  void Draw(const Bitmap& Bmp, int32_t X, int32_t Y, uint32_t Mask = 0x000000);
-#endif
+  BitmapA ToBitmap(const Palette& Pal) const;
+  // PNG stays indexed: the palette goes to PLTE, and transparent pixels take
+  // an index no opaque pixel uses, made transparent by tRNS
+  void Save(const char* Path, const Palette& Pal, const ImgOptions& Opt = {}) const;
 private:
   using RcArray::NRow;
   using RcArray::NCol;
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Common.hpp"
+
+template<class Elem>
+class RcArray;
+
+// Non-owning, strided window into the rows of a larger image. Views are
+// cheap to copy; the viewed storage must outlive them.
+template<class Elem>
+class BitmapView {
+public:
+  using Value = remove_const_t<Elem>;
+  // A view of const elements can be made from a const array
+  using Array = conditional_t<is_const_v<Elem>, const RcArray<Value>, RcArray<Value>>;
+
+  constexpr BitmapView() noexcept = default;
+  // Stride: distance between the rows, in elements
+  constexpr BitmapView(Elem* Ptr_, size_t W_, size_t H_, ptrdiff_t Stride_) noexcept :
+    Ptr(Ptr_), W(W_), H(H_), Str(Stride_) {}
+  // The whole of a bitmap or coverage
+  BitmapView(Array& Arr) noexcept : BitmapView(Arr.Raw(), Arr.NCol(), Arr.NRow(), (ptrdiff_t) Arr.NCol()) {}
+  // Mutable views convert to read-only ones
+  template<class E = Elem, class = enable_if_t<is_const_v<E>>>
+  constexpr BitmapView(const BitmapView<Value>& View) noexcept :
+    BitmapView(View.Raw(), View.Width(), View.Height(), View.Stride()) {}
+
+  constexpr size_t Width() const noexcept { return W; }
+  constexpr size_t Height() const noexcept { return H; }
+  constexpr ptrdiff_t Stride() const noexcept { return Str; }
+  constexpr size_t Count() const noexcept { return W * H; }
+  constexpr Elem* Raw() const noexcept { return Ptr; }
+
+  constexpr Elem* operator [](size_t R) const noexcept { return Ptr + (ptrdiff_t) R * Str; }
+
+  // W x H window at (X, Y), which must be inside this view
+  BitmapView Sub(size_t X, size_t Y, size_t W_, size_t H_) const {
+    Assert(X + W_ <= W && Y + H_ <= H);
+    return {(*this)[Y] + X, W_, H_, Str};
+  }
+
+  void Fill(const Value& Val) const {
+    for (auto y = size_t{0}; y < H; ++y)
+      fill_n((*this)[y], W, Val);
+  }
+private:
+  Elem* Ptr = nullptr;
+  size_t W = 0;
+  size_t H = 0;
+  ptrdiff_t Str = 0;
+};
@@ -1,16 +1,38 @@
 #include "Common.hpp"
 
+#include <atomic>
+
+namespace {
+  atomic<bool> AbortThrows{false};
+}
+
 void Warn(const char* Fmt, ...) {
-  fputs("[WARN] ", stderr);
+  // A single write, so that warnings from several threads do not interleave
+  char Buf[1024];
   va_list Args;
   va_start(Args, Fmt);
-  vfprintf(stderr, Fmt, Args);
+  vsnprintf(Buf, sizeof(Buf), Fmt, Args);
   va_end(Args);
-  fputc('\n', stderr);
+  fprintf(stderr, "[WARN] %s\n", Buf);
+}
+
+void SetAbortThrows(bool On) noexcept {
+  AbortThrows = On;
 }
 
 [[noreturn]]
 void AbortV(const char* Fmt, va_list Args) {
+  if (AbortThrows) {
+    va_list Copy;
+    va_copy(Copy, Args);
+    auto Len = vsnprintf(nullptr, 0, Fmt, Copy);
+    va_end(Copy);
+    string Msg(Len > 0 ? (size_t) Len : 0, '\0');
+    vsnprintf(Msg.data(), Msg.size() + 1, Fmt, Args);
+    while (!Msg.empty() && Msg.back() == '\n')
+      Msg.pop_back();
+    throw AbortError(Msg);
+  }
   fputs("[ABORT] ", stderr);
   vfprintf(stderr, Fmt, Args);
   fputc('\n', stderr);
@@ -24,3 +46,10 @@ void Abort(const char* Fmt, ...) {
   AbortV(Fmt, Args);
   va_end(Args);
 }
+
+uint64_t Fnv1a(const void* Ptr, size_t Size, uint64_t Hash) {
+  auto Bytes = (const uint8_t*) Ptr;
+  for (auto i = size_t{0}; i < Size; ++i)
+    Hash = (Hash ^ Bytes[i]) * 0x100000001b3;
+  return Hash;
+}
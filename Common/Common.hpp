@@ -10,7 +10,9 @@
 #include <cstdlib>
 #include <cstring>
 #include <iomanip>
+#include <list>
 #include <memory>
+#include <stdexcept>
 #include <sstream>
 #include <string>
 #include <string_view>
@@ -21,6 +23,16 @@ using namespace std;
 
 void Warn(const char* Fmt, ...);
 
+// Thrown by Abort once SetAbortThrows is on, carrying the message
+class AbortError : public runtime_error {
+public:
+  using runtime_error::runtime_error;
+};
+
+// Off: Abort prints and ends the process, as the tools want. On: it throws
+// AbortError on whichever thread fails, for hosts that outlive the error.
+void SetAbortThrows(bool On) noexcept;
+
 [[noreturn]]
 void AbortV(const char* Fmt, va_list Args);
 
@@ -38,4 +50,24 @@ T Cast(U Val, const char* Fmt, ...) {
   return static_cast<T>(Val);
 }
 
+// Decimal digits only, Desc names the value in the errors
+template<class T>
+T Parse(const char* S, const char* Desc) {
+  if (!*S)
+    Abort("Failed to parse %s", Desc);
+  uintmax_t Res{};
+  while (*S) {
+    if (!isdigit((unsigned char) *S))
+      Abort("Failed to parse %s", Desc);
+    auto Tmp = Res * 10 + (*S++ & 0xf);
+    if (Tmp < Res)
+      Abort("Integer overflow when parsing %s", Desc);
+    Res = Tmp;
+  }
+  return Cast<T>(Res, "The %s is too large (%" PRIuMAX ")", Desc, Res);
+}
+
+// 64-bit FNV-1a, chainable through Hash
+uint64_t Fnv1a(const void* Ptr, size_t Size, uint64_t Hash = 0xcbf29ce484222325);
+
 #define Assert(e_) ((void) ((e_) || (Abort("Assertion failed: " # e_ "\n"), 0)))
@@ -0,0 +1,155 @@
+#include "AutoFile.hpp"
+#include "Config.hpp"
+#include "Usage.hpp"
+
+// Missing keys and keys of the wrong type fail through Abort, so that they
+// are errors for library hosts rather than asserts
+#define RAPIDJSON_ASSERT(x) Assert(x)
+#define RAPIDJSON_ASSERT_THROWS
+#include "rapidjson/document.h"
+
+namespace {
+  Pixel ParseCol(const rapidjson::Value& V, const char* Desc) {
+    if (!V.IsArray() || V.Size() != 3)
+      Abort("The %s should be given as [R, G, B]", Desc);
+    return {
+      Cast<uint8_t>(V[0].GetInt(), "The red of %s is out of range", Desc),
+      Cast<uint8_t>(V[1].GetInt(), "The green of %s is out of range", Desc),
+      Cast<uint8_t>(V[2].GetInt(), "The blue of %s is out of range", Desc),
+    };
+  }
+
+  // Keys of a family entry override the shared ones
+  class Keys {
+  public:
+    Keys(const rapidjson::Value& Base_, const rapidjson::Value* Over_) noexcept : Base(&Base_), Over(Over_) {}
+
+    bool HasMember(const char* Key) const { return (Over && Over->HasMember(Key)) || Base->HasMember(Key); }
+
+    const rapidjson::Value& operator [](const char* Key) const {
+      if (!HasMember(Key))
+        Abort("The config has no %s", Key);
+      return Over && Over->HasMember(Key) ? (*Over)[Key] : (*Base)[Key];
+    }
+  private:
+    const rapidjson::Value* Base;
+    const rapidjson::Value* Over;
+  };
+
+  // One size, the keys of which are given by d
+  void ReadSize(FontConfig& Cfg, const Keys& d, const CharUsage* Usage, Font& Fnt) {
+    auto FacePath = d["path"].GetString();
+    auto Size = Cast<uint16_t>(d["size"].GetInt(), "The size is out of range");
+    Cfg.PalPath = d["pal"].GetString();
+    Cfg.Dc6Path = d["dc6name"].GetString();
+    Cfg.TblPath = d["tblname"].GetString();
+    Cfg.LogPath = d.HasMember("log") ? d["log"].GetString() : "";
+    Cfg.Dc6OffsetY = d["Dc6OffsetY"].GetInt();
+    Cfg.NThread = d.HasMember("threads") ? d["threads"].GetUint() : 0u;
+    auto AntiAliasing = d["aa"].GetBool(); // currently global
+    Pixel FgCol{255, 255, 255};
+    Pixel BgCol{0, 0, 0};
+    if (d.HasMember("glyphColor"))
+      FgCol = ParseCol(d["glyphColor"], "glyph color");
+    if (d.HasMember("bgColor"))
+      BgCol = ParseCol(d["bgColor"], "background color");
+    auto Sharpen = d.HasMember("sharpening") ? d["sharpening"].GetFloat() : 0.0f;
+    auto Contrast = d.HasMember("contrast") ? d["contrast"].GetFloat() : 1.0f;
+    auto Gamma = d.HasMember("gamma") ? d["gamma"].GetFloat() : 1.0f;
+    auto Supersample = d.HasMember("supersample") ? d["supersample"].GetUint() : 1u;
+    Fnt.Size = Size;
+    Fnt.HeightConstant = d["leadingfactor"].GetInt();
+    Fnt.LnSpacingOff = d["LeadingOffset"].GetInt();
+    Fnt.CapHeight = d["CapHeight"].GetInt();
+    Fnt.OriginOffset = d["OriginOffset"].GetInt();
+    Fnt.Filter.Setup(Sharpen, Contrast, Gamma);
+    Fnt.Faces.emplace_back(FacePath);
+    bitset<0x10000> Dropped;
+    // Each entry of ranges is an object whose first member is [First, Last].
+    // Ranges with "subset": false are kept whole, e.g. for digits and names.
+    auto& Ranges = d["ranges"];
+    Cfg.Ranges.clear();
+    for (auto It = Ranges.Begin(); It != Ranges.End(); ++It) {
+      if (It->MemberBegin() == It->MemberEnd())
+        continue;
+      auto& Range = It->MemberBegin()->value;
+      auto First = (uint32_t) Range[0].GetInt();
+      auto Last = (uint32_t) Range[1].GetInt();
+      auto Keep = !Usage || (It->HasMember("subset") && !(*It)["subset"].GetBool());
+      auto Note = It->HasMember("note") && (*It)["note"].IsString() ? (*It)["note"].GetString() : "";
+      Cfg.Ranges.push_back({First, Last, Note});
+      for (auto Ch = First; Ch <= Last; ++Ch) {
+        Cast<uint16_t>(Ch, "Char (%u) is out of range", Ch);
+        if (!Keep && !Usage->Has((uint16_t) Ch)) {
+          Dropped.set(Ch);
+          continue;
+        }
+        auto& G = Fnt.Glyphs[Ch];
+        G.reset(new FontGlyph);
+        G->Char = (uint16_t) Ch;
+        G->AntiAliasing = AntiAliasing;
+        G->Supersample = Supersample;
+        G->FgCol = FgCol;
+        G->BgCol = BgCol;
+        G->Size = Size;
+        G->FaceIdx = 0;
+        G->HasBmp = false;
+      }
+    }
+    Cfg.NUnused = 0;
+    for (auto Ch = 0u; Ch < 0x10000; ++Ch)
+      Cfg.NUnused += Dropped[Ch] && !Fnt.Glyphs[Ch];
+  }
+
+  // FontOf(i): the font to set up for size i, at most Limit sizes are read
+  template<class FontFn>
+  bool ReadSizes(const char* Path, size_t Limit, vector<FontConfig>& Cfgs, FontFn&& FontOf) {
+    auto Json = AutoFile(Path, "rb").ReadAll();
+    rapidjson::Document d;
+    d.Parse(Json.c_str());
+    if (!d.IsObject() || !d.HasMember("filename"))
+      return false;
+    // With usage, the ranges are cut down to the chars of the string tables
+    // and text exports it lists, which are scanned once for all sizes
+    CharUsage Usage;
+    auto Subset = false;
+    if (d.HasMember("usage") && d["usage"].Size()) {
+      vector<string> Paths;
+      auto& Files = d["usage"];
+      for (auto It = Files.Begin(); It != Files.End(); ++It)
+        Paths.emplace_back(It->GetString());
+      Usage.Scan(Paths, d.HasMember("threads") ? d["threads"].GetUint() : 0u);
+      Subset = true;
+    }
+    if (!d.HasMember("family") || !d["family"].Size()) {
+      ReadSize(Cfgs.emplace_back(), Keys(d, nullptr), Subset ? &Usage : nullptr, FontOf(0));
+      Cfgs.back().UsagePaths = Usage.Inputs();
+      return true;
+    }
+    auto& Family = d["family"];
+    for (auto i = 0u; i < Family.Size() && i < Limit; ++i) {
+      auto& Entry = Family[i];
+      if (!Entry.HasMember("dc6name") || !Entry.HasMember("tblname"))
+        Abort("Size %u of the family should have its own dc6name and tblname", i);
+      auto& Cfg = Cfgs.emplace_back();
+      ReadSize(Cfg, Keys(d, &Entry), Subset ? &Usage : nullptr, FontOf(i));
+      Cfg.UsagePaths = Usage.Inputs();
+      for (auto j = size_t{0}; j + 1 < Cfgs.size(); ++j)
+        if (Cfgs[j].Dc6Path == Cfg.Dc6Path || Cfgs[j].TblPath == Cfg.TblPath)
+          Abort("Sizes %zu and %u of the family have the same output", j, i);
+    }
+    return true;
+  }
+}
+
+bool FontConfig::Read(const char* Path, Font& Fnt) {
+  vector<FontConfig> Cfgs;
+  if (!ReadSizes(Path, 1, Cfgs, [&](size_t) -> Font& { return Fnt; }))
+    return false;
+  *this = move(Cfgs[0]);
+  return true;
+}
+
+bool ReadFamily(const char* Path, vector<FontConfig>& Cfgs, vector<unique_ptr<Font>>& Fnts) {
+  return ReadSizes(Path, SIZE_MAX, Cfgs, [&](size_t) -> Font& { return *Fnts.emplace_back(new Font); });
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Common.hpp"
+#include "Font.hpp"
+
+// Entry of "ranges", with its "note" if any
+struct CharRange {
+  uint32_t First;
+  uint32_t Last;
+  string Note;
+};
+
+// Build settings of D2MFC, read from its JSON config
+struct FontConfig {
+  string Dc6Path;
+  string TblPath;
+  string PalPath;
+  string LogPath;     // diagnostics as JSON, none if empty
+  int32_t Dc6OffsetY{};
+  uint32_t NThread{}; // 0: one per core
+  size_t NUnused{};   // chars of the ranges dropped, as no string uses them
+  vector<CharRange> Ranges;
+  vector<string> UsagePaths; // as scanned for "usage", see CharUsage::Inputs
+
+  // Sets up the parameters and the glyphs of Fnt, the first size of a
+  // family. False if the file is not a config at all (no filename).
+  bool Read(const char* Path, Font& Fnt);
+};
+
+// Every size of a config: one, or one for each entry of "family". The keys
+// of an entry override the shared ones, and each entry names its own
+// dc6name and tblname.
+bool ReadFamily(const char* Path, vector<FontConfig>& Cfgs, vector<unique_ptr<Font>>& Fnts);
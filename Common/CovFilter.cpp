@@ -0,0 +1,140 @@
+#include "CovFilter.hpp"
+
+#include <math.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define COV_SSE2
+#endif
+
+namespace {
+  // Columns of zero padding on each side of a row, the right side also
+  // covers the over-read of 8-pixel loads
+  constexpr size_t PadL = 1;
+  constexpr size_t PadR = 9;
+
+  // c + Amount * (c - blur) where blur is [1 2 1] x [1 2 1] / 16
+  inline uint8_t SharpenPix(const uint8_t* U, const uint8_t* C, const uint8_t* D, int32_t Amount) {
+    auto V0 = U[-1] + 2 * C[-1] + D[-1];
+    auto V1 = U[0] + 2 * C[0] + D[0];
+    auto V2 = U[1] + 2 * C[1] + D[1];
+    auto Blur = (V0 + 2 * V1 + V2) >> 4;
+    auto Res = C[0] + (((C[0] - Blur) * Amount) >> 9);
+    return (uint8_t) min(max(Res, 0), 255);
+  }
+}
+
+void CovFilter::Setup(float Sharpen, float Contrast, float Gamma) {
+  if (Sharpen < 0 || Sharpen >= 64)
+    Abort("Sharpening amount (%g) should be in [0, 64)", Sharpen);
+  if (Contrast <= 0)
+    Abort("Contrast (%g) should be positive", Contrast);
+  if (Gamma <= 0)
+    Abort("Gamma (%g) should be positive", Gamma);
+  Amount = (int16_t) lround(Sharpen * 512);
+  HasTone = Contrast != 1 || Gamma != 1;
+  Tone[0] = 0;
+  for (auto i = 1u; i < 256; ++i) {
+    auto V = ((float) i / 255 - 0.5f) * Contrast + 0.5f;
+    V = powf(min(max(V, 0.0f), 1.0f), 1 / Gamma);
+    Tone[i] = (uint8_t) lroundf(V * 255);
+  }
+}
+
+void CovFilter::Apply(Coverage& Cov, vector<uint8_t>& Buf) const {
+  if (!Cov.Count())
+    return;
+  if (Amount)
+    Sharpen(Cov, Buf);
+  if (HasTone) {
+    auto Ptr = Cov.Raw();
+    for (auto i = size_t{0}; i < Cov.Count(); ++i)
+      Ptr[i] = Tone[Ptr[i]];
+  }
+}
+
+void CovFilter::Sharpen(Coverage& Cov, vector<uint8_t>& Buf) const {
+  auto W = Cov.Width();
+  auto H = Cov.Height();
+  auto Stride = PadL + W + PadR;
+  // Zero-padded copy, with one extra row above and below
+  Buf.assign(Stride * (H + 2), 0);
+  for (auto y = 0u; y < H; ++y)
+    copy_n(Cov[y], W, Buf.data() + (y + 1) * Stride + PadL);
+  for (auto y = 0u; y < H; ++y) {
+    auto U = Buf.data() + y * Stride + PadL;
+    auto C = U + Stride;
+    auto D = C + Stride;
+    auto Dst = Cov[y];
+    auto x = size_t{0};
+#ifdef COV_SSE2
+    auto Zero = _mm_setzero_si128();
+    auto Amt = _mm_set1_epi16(Amount);
+    auto Load = [&](const uint8_t* P) {
+      return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) P), Zero);
+    };
+    auto Col = [&](ptrdiff_t Off) {
+      auto V = _mm_add_epi16(Load(U + x + Off), Load(D + x + Off));
+      return _mm_add_epi16(V, _mm_slli_epi16(Load(C + x + Off), 1));
+    };
+    for (; x + 8 <= W; x += 8) {
+      auto Blur = _mm_add_epi16(_mm_add_epi16(Col(-1), Col(1)), _mm_slli_epi16(Col(0), 1));
+      Blur = _mm_srli_epi16(Blur, 4);
+      auto Cur = Load(C + x);
+      // (Cur - Blur) * Amount / 512 through the high half of a Q16 product
+      auto Diff = _mm_slli_epi16(_mm_sub_epi16(Cur, Blur), 7);
+      auto Res = _mm_add_epi16(Cur, _mm_mulhi_epi16(Diff, Amt));
+      _mm_storel_epi64((__m128i*) (Dst + x), _mm_packus_epi16(Res, Res));
+    }
+#endif
+    for (; x < W; ++x)
+      Dst[x] = SharpenPix(U + x, C + x, D + x, Amount);
+  }
+}
+
+void Downsample(Coverage& Dst, const uint8_t* Src, ptrdiff_t Pitch, size_t W, size_t H,
+  uint32_t OffX, uint32_t OffY, uint32_t K, vector<uint16_t>& Acc) {
+  Assert(K >= 1 && K <= 16);
+  Dst.Resize((OffX + W + K - 1) / K, (OffY + H + K - 1) / K);
+  Downsample(BitmapView<uint8_t>(Dst), Src, Pitch, W, H, OffX, OffY, K, Acc);
+}
+
+void Downsample(BitmapView<uint8_t> Dst, const uint8_t* Src, ptrdiff_t Pitch, size_t W, size_t H,
+  uint32_t OffX, uint32_t OffY, uint32_t K, vector<uint16_t>& Acc) {
+  Assert(K >= 1 && K <= 16 && OffX < K && OffY < K);
+  auto DW = (OffX + W + K - 1) / K;
+  auto DH = (OffY + H + K - 1) / K;
+  Assert(Dst.Width() == DW && Dst.Height() == DH);
+  // Rounded division by K * K as a Q16 multiplication
+  auto Mul = (65536 + K * K / 2) / (K * K);
+  for (auto Y = size_t{0}; Y < DH; ++Y) {
+    // Vertical sums of the K source rows, on the K x K grid
+    Acc.assign(DW * K, 0);
+    auto RBeg = Y * K > OffY ? Y * K - OffY : 0;
+    auto REnd = min((Y + 1) * K - OffY, H);
+    for (auto r = RBeg; r < REnd; ++r) {
+      auto Row = Src + (ptrdiff_t) r * Pitch;
+      auto Out = Acc.data() + OffX;
+      auto x = size_t{0};
+#ifdef COV_SSE2
+      auto Zero = _mm_setzero_si128();
+      for (; x + 16 <= W; x += 16) {
+        auto V = _mm_loadu_si128((const __m128i*) (Row + x));
+        auto Lo = _mm_loadu_si128((const __m128i*) (Out + x));
+        auto Hi = _mm_loadu_si128((const __m128i*) (Out + x + 8));
+        _mm_storeu_si128((__m128i*) (Out + x), _mm_add_epi16(Lo, _mm_unpacklo_epi8(V, Zero)));
+        _mm_storeu_si128((__m128i*) (Out + x + 8), _mm_add_epi16(Hi, _mm_unpackhi_epi8(V, Zero)));
+      }
+#endif
+      for (; x < W; ++x)
+        Out[x] += Row[x];
+    }
+    auto Out = Dst[Y];
+    for (auto X = size_t{0}; X < DW; ++X) {
+      auto Sum = 0u;
+      for (auto j = 0u; j < K; ++j)
+        Sum += Acc[X * K + j];
+      Out[X] = (uint8_t) min((Sum * Mul + 32768) >> 16, 255u);
+    }
+  }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Common.hpp"
+#include "Coverage.hpp"
+
+// Post-rasterization unsharp mask and tone curve on coverage
+class CovFilter {
+public:
+  // Sharpen: unsharp mask amount (0 to disable), up to 63
+  // Contrast: slope around half coverage, 1 to disable
+  // Gamma: applied after contrast, 1 to disable
+  void Setup(float Sharpen, float Contrast, float Gamma);
+
+  constexpr bool Empty() const noexcept { return !Amount && !HasTone; }
+
+  // Buf is scratch memory, so that it can be reused between glyphs
+  void Apply(Coverage& Cov, vector<uint8_t>& Buf) const;
+private:
+  int16_t Amount{}; // Q9
+  bool HasTone{};
+  array<uint8_t, 256> Tone{};
+
+  void Sharpen(Coverage& Cov, vector<uint8_t>& Buf) const;
+};
+
+// Box filters an 8-bit image rendered at K times the size into Dst. The
+// image is placed at (OffX, OffY) on the K x K grid of the Dst pixels.
+void Downsample(Coverage& Dst, const uint8_t* Src, ptrdiff_t Pitch, size_t W, size_t H,
+  uint32_t OffX, uint32_t OffY, uint32_t K, vector<uint16_t>& Acc);
+// Same, into a window of exactly the downsampled size
+void Downsample(BitmapView<uint8_t> Dst, const uint8_t* Src, ptrdiff_t Pitch, size_t W, size_t H,
+  uint32_t OffX, uint32_t OffY, uint32_t K, vector<uint16_t>& Acc);
@@ -0,0 +1,54 @@
+#include "Coverage.hpp"
+
+namespace {
+  constexpr uint8_t Blend(uint32_t Fg, uint32_t Bg, uint32_t Cov) {
+    return (uint8_t) ((Fg * Cov + Bg * (255 - Cov) + 127) / 255);
+  }
+}
+
+void CovLut::FromPalette(const Palette& Pal) {
+  FromRamp(Pal, 0xffffff, 0x000000);
+}
+
+void CovLut::FromRamp(const Palette& Pal, const Pixel& Fg, const Pixel& Bg) {
+  for (auto i = 0u; i < 256; ++i) {
+    Pixel Pix;
+    Pix.R = Blend(Fg.R, Bg.R, i);
+    Pix.G = Blend(Fg.G, Bg.G, i);
+    Pix.B = Blend(Fg.B, Bg.B, i);
+    (*this)[i] = Pal.Encode(Pix);
+  }
+}
+
+CovRamps::CovRamps(const Palette& Pal) noexcept : Pal(&Pal) {}
+
+uint16_t CovRamps::Find(const Pixel& Fg, const Pixel& Bg) {
+  auto Key = (uint64_t) Fg.Rgb() << 32 | Bg.Rgb();
+  auto Res = Map.find(Key);
+  if (Res != Map.end())
+    return Res->second;
+  auto Idx = Cast<uint16_t>(Luts.size(), "Too many color ramps (%zu)", Luts.size());
+  Luts.emplace_back().FromRamp(*Pal, Fg, Bg);
+  Map.emplace(Key, Idx);
+  return Idx;
+}
+
+void Coverage::Draw(BitmapView<const uint8_t> Cov, int32_t X, int32_t Y, Diagnostics& Diag, uint32_t Ch) {
+  ::Draw(*this, Cov, X, Y, Diag, Ch);
+}
+
+Bitmap Coverage::ToBitmap() const {
+  Bitmap Bmp(Width(), Height());
+  auto Src = Raw();
+  auto Dst = Bmp.Raw();
+  for (auto i = size_t{0}; i < Count(); ++i) {
+    Dst[i].R = Src[i];
+    Dst[i].G = Src[i];
+    Dst[i].B = Src[i];
+  }
+  return Bmp;
+}
+
+void Coverage::Save(const char* Path, const ImgOptions& Opt) const {
+  SaveImage(Path, BitmapView<const uint8_t>(*this), Opt);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Bitmap.hpp"
+#include "Common.hpp"
+#include "RcArray.hpp"
+
+// Coverage (0: transparent, 1-255: opaque) to palette index
+class CovLut : public array<uint8_t, 256> {
+public:
+  using array::array;
+
+  void FromPalette(const Palette& Pal);
+  // Coverage blends from Bg to Fg before being encoded
+  void FromRamp(const Palette& Pal, const Pixel& Fg, const Pixel& Bg);
+};
+
+// Ramps for every (Fg, Bg) pair of a palette, built on first use
+class CovRamps {
+public:
+  CovRamps(const Palette& Pal) noexcept;
+
+  uint16_t Find(const Pixel& Fg, const Pixel& Bg);
+
+  size_t Count() const noexcept { return Luts.size(); }
+
+  const CovLut& operator [](size_t Idx) const noexcept { return Luts[Idx]; }
+private:
+  const Palette* Pal;
+  vector<CovLut> Luts;
+  unordered_map<uint64_t, uint16_t> Map;
+};
+
+// Single channel glyph bitmap, as produced by the rasterizer
+class Coverage : public RcArray<uint8_t> {
+public:
+  constexpr Coverage() noexcept = default;
+  Coverage(const Coverage&) noexcept = default;
+  Coverage(Coverage&&) noexcept = default;
+  Coverage(size_t W, size_t H) noexcept : RcArray(H, W) {}
+
+  Coverage& operator =(const Coverage&) noexcept = default;
+  Coverage& operator =(Coverage&&) noexcept = default;
+
+  constexpr size_t Width() const noexcept { return NCol(); }
+  constexpr size_t Height() const noexcept { return NRow(); }
+
+  void Resize(size_t W, size_t H) { RcArray::Resize(H, W); }
+
+  // Ch: the char drawn, for the diagnostics
+  void Draw(BitmapView<const uint8_t> Cov, int32_t X, int32_t Y, Diagnostics& Diag = Diags(),
+    uint32_t Ch = Diagnostics::NoChar);
+
+  // Grayscale RGB image, for debug output only
+  Bitmap ToBitmap() const;
+  // Saved as a grayscale image
+  void Save(const char* Path, const ImgOptions& Opt = {}) const;
+private:
+  using RcArray::NRow;
+  using RcArray::NCol;
+};
@@ -0,0 +1,151 @@
+#include "AutoFile.hpp"
+#include "Diag.hpp"
+
+namespace {
+  struct KindInfo {
+    const char* Name; // key of the log
+    const char* Desc;
+  };
+
+  constexpr KindInfo Kinds[] = {
+    {"NoGlyph", "No glyph found, a dummy (1x1) bitmap is generated"},
+    {"EmptyGlyph", "Empty bitmap generated, a dummy (1x1) bitmap is generated"},
+    {"NegBearX", "BearX is negative, set to 0"},
+    {"CroppedOut", "The bitmap is completely cropped out, a dummy (1x1) bitmap is generated"},
+    {"NotDrawn", "No bitmap is drawn, as it is outside the canvas"},
+    {"Cropped", "Bitmap is cropped to the canvas"},
+  };
+  static_assert(size(Kinds) == (size_t) DiagKind::Count);
+
+  constexpr size_t MaxPrinted = 8;
+
+  // Consecutive chars are coalesced into [First, Last]
+  vector<pair<uint32_t, uint32_t>> ToRanges(vector<uint32_t> Chars) {
+    sort(Chars.begin(), Chars.end());
+    Chars.erase(unique(Chars.begin(), Chars.end()), Chars.end());
+    vector<pair<uint32_t, uint32_t>> Ranges;
+    for (auto Ch : Chars)
+      if (!Ranges.empty() && Ranges.back().second + 1 == Ch)
+        Ranges.back().second = Ch;
+      else
+        Ranges.emplace_back(Ch, Ch);
+    return Ranges;
+  }
+}
+
+void Diagnostics::Add(DiagKind Kind, uint32_t Ch) {
+  lock_guard<mutex> Lock(Mtx);
+  ++Counts[(size_t) Kind];
+  if (Ch != NoChar)
+    Chars[(size_t) Kind].emplace_back(Ch);
+}
+
+void Diagnostics::Clear() {
+  lock_guard<mutex> Lock(Mtx);
+  Counts.fill(0);
+  for (auto& C : Chars)
+    C.clear();
+  Parts.clear();
+}
+
+size_t Diagnostics::Count(DiagKind Kind) const {
+  lock_guard<mutex> Lock(Mtx);
+  auto N = Counts[(size_t) Kind];
+  for (auto& P : Parts)
+    N += P.second.Count(Kind);
+  return N;
+}
+
+Diagnostics& Diagnostics::Part(const string& Name) {
+  lock_guard<mutex> Lock(Mtx);
+  for (auto& P : Parts)
+    if (P.first == Name)
+      return P.second;
+  Parts.emplace_back(piecewise_construct, forward_as_tuple(Name), forward_as_tuple());
+  return Parts.back().second;
+}
+
+void Diagnostics::Print(FILE* File) const {
+  lock_guard<mutex> Lock(Mtx);
+  PrintLines(File, nullptr);
+  for (auto& [Name, P] : Parts) {
+    lock_guard<mutex> PartLock(P.Mtx);
+    P.PrintLines(File, Name.c_str());
+  }
+}
+
+void Diagnostics::SaveLog(const char* Path) const {
+  lock_guard<mutex> Lock(Mtx);
+  ostringstream Log;
+  if (Parts.empty())
+    WriteLog(Log, "");
+  else {
+    // Keyed by part, those of this object are left out
+    Log << '{';
+    auto First = true;
+    for (auto& [Name, P] : Parts) {
+      Log << (First ? "\n" : ",\n") << "  \"";
+      First = false;
+      for (auto c : Name) {
+        if (c == '"' || c == '\\')
+          Log << '\\';
+        Log << c;
+      }
+      Log << "\": ";
+      lock_guard<mutex> PartLock(P.Mtx);
+      P.WriteLog(Log, "  ");
+    }
+    Log << (First ? "}" : "\n}");
+  }
+  Log << '\n';
+  auto Str = Log.str();
+  AutoFile(Path, "wb").Put(Str.data(), Str.size());
+}
+
+void Diagnostics::PrintLines(FILE* File, const char* Prefix) const {
+  for (auto k = size_t{0}; k < size(Kinds); ++k) {
+    if (!Counts[k])
+      continue;
+    ostringstream Line;
+    Line << "[WARN] ";
+    if (Prefix)
+      Line << Prefix << ": ";
+    Line << Kinds[k].Desc << ": " << Counts[k] << " time" << (Counts[k] > 1 ? "s" : "");
+    auto Ranges = ToRanges(Chars[k]);
+    if (!Ranges.empty()) {
+      Line << ", chars";
+      for (auto i = size_t{0}; i < Ranges.size() && i < MaxPrinted; ++i) {
+        Line << (i ? ", " : " ") << Ranges[i].first;
+        if (Ranges[i].second != Ranges[i].first)
+          Line << '-' << Ranges[i].second;
+      }
+      if (Ranges.size() > MaxPrinted)
+        Line << " and " << Ranges.size() - MaxPrinted << " more ranges";
+    }
+    Line << '\n';
+    fputs(Line.str().c_str(), File);
+  }
+}
+
+void Diagnostics::WriteLog(ostringstream& Log, const char* Indent) const {
+  Log << '{';
+  auto First = true;
+  for (auto k = size_t{0}; k < size(Kinds); ++k) {
+    if (!Counts[k])
+      continue;
+    Log << (First ? "\n" : ",\n") << Indent << "  \"" << Kinds[k].Name << "\": {\"count\": " << Counts[k] << ", \"chars\": [";
+    First = false;
+    auto Ranges = ToRanges(Chars[k]);
+    for (auto i = size_t{0}; i < Ranges.size(); ++i)
+      Log << (i ? ", [" : "[") << Ranges[i].first << ", " << Ranges[i].second << ']';
+    Log << "]}";
+  }
+  if (!First)
+    Log << '\n' << Indent;
+  Log << '}';
+}
+
+Diagnostics& Diags() {
+  static Diagnostics Res;
+  return Res;
+}
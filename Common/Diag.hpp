@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include <mutex>
+
+// Warnings that come once per glyph or per draw, so that a full-range build
+// would print thousands of them
+enum class DiagKind : uint8_t {
+  NoGlyph,    // no face has the char, a dummy bitmap is made
+  EmptyGlyph, // the glyph has no pixels, a dummy bitmap is made
+  NegBearX,   // BearX is negative, set to 0
+  CroppedOut, // the padded bitmap has no room left, a dummy bitmap is made
+  NotDrawn,   // a bitmap is drawn wholly outside its canvas
+  Cropped,    // a bitmap is drawn partly outside its canvas
+  Count
+};
+
+// Counts warnings by kind instead of printing them one by one. The chars a
+// kind is about are kept, and reported as ranges.
+class Diagnostics {
+public:
+  static constexpr uint32_t NoChar = ~0u;
+
+  void Add(DiagKind Kind, uint32_t Ch = NoChar);
+  // Drops the parts too
+  void Clear();
+  // Warnings kept apart under a name, such as those of one font of a family
+  // by its DC6. Valid until Clear.
+  Diagnostics& Part(const string& Name);
+
+  // Parts included
+  size_t Count(DiagKind Kind) const;
+
+  // A line for each kind seen, listing the first few ranges of chars. Lines
+  // of a part start with its name.
+  void Print(FILE* File = stderr) const;
+  // JSON object of the kinds seen, with their counts and all the ranges. With
+  // parts, an object of those by name instead.
+  void SaveLog(const char* Path) const;
+private:
+  mutable mutex Mtx;
+  array<size_t, (size_t) DiagKind::Count> Counts{};
+  array<vector<uint32_t>, (size_t) DiagKind::Count> Chars;
+  list<pair<string, Diagnostics>> Parts; // nodes stay in place as others are added
+
+  void PrintLines(FILE* File, const char* Prefix) const;
+  void WriteLog(ostringstream& Log, const char* Indent) const;
+};
+
+// Shared by the whole process, a FontService has its own
+Diagnostics& Diags();
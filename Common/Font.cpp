@@ -1,8 +1,14 @@
+#include "Diag.hpp"
 #include "Font.hpp"
+#include "MappedFile.hpp"
+#include "Pipeline.hpp"
 
+#include <map>
 #include <math.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include FT_OUTLINE_H
+#include FT_SIZES_H
 
 #define FtAss(e_) ((void) (!(e_) || (Abort("FreeType call failed: " # e_ ""), 0)))
 
@@ -17,36 +23,461 @@ void Font::Clear() {
   LnSpacing = 0;
   CapHeight = 0;
   UnkHZ = 0;
+  Lazy = nullptr;
+  Deferred.clear();
+  Raster.reset();
 }
 
-void Font::FromSprTbl(Sprite& Spr, FontTable& Tbl) {
-  if (Spr.NDir() != 1)
-    Abort("The number of directions should be 1 instead of %zu", Spr.NDir());
-  if (Tbl.Hdr.NChar != Spr.NFrm())
-    Abort("The number of images (%zu) should be the same with characters (%u)", Spr.NFrm(), Tbl.Hdr.NChar);
-  Clear();
-  Size = Tbl.Hdr.LnSpacing;
-  LnSpacing = Tbl.Hdr.LnSpacing;
-  CapHeight = Tbl.Hdr.CapHeight;
-  UnkHZ = Tbl.Hdr.UnkHZ;
-  for (auto i = 0u; i < Spr.NFrm(); ++i) {
-    auto& C = Tbl.Chrs[i];
-    auto& G = Glyphs[C.Char];
-    Assert(!G);
-    G.reset(new FontGlyph);
-    G->Char = C.Char;
-    G->Size = Tbl.Hdr.LnSpacing;
-    G->UnkTwo = C.UnkTwo;
-    G->HasBmp = 2;
-    G->BearY = C.Height;
-    G->Advance = C.Width;
-    if (C.Dc6Index >= Spr.NFrm())
-      Abort("DC6 index (%u) is too large for char (%u): should be less than %zu", C.Dc6Index, G->Char, Spr.NFrm());
-    G->Bmp = move(Spr[0][C.Dc6Index]);
+namespace {
+  // Advance in pixels of a glyph rendered at K times the size
+  uint32_t ScaleAdvance(FT_Pos Adv, int32_t K) {
+    return (uint32_t) (K > 1 ? (Adv + 32 * K) / (64 * K) : Adv >> 6);
+  }
+
+  uint32_t LoadFlags(const FontGlyph& G) {
+    if (G.Supersample > 1)
+      return FT_LOAD_DEFAULT | FT_LOAD_NO_BITMAP; // always grayscale, see RenderGlyphs
+    return G.AntiAliasing ? FT_LOAD_DEFAULT : FT_LOAD_TARGET_MONO | FT_LOAD_MONOCHROME;
+  }
+
+  // Loads glyphs, faces are opened on first use and kept open. Each pixel
+  // size gets its own FT_Size, and glyph indices are looked up once, so the
+  // sizes of a family share one session. Faces are read from files mapped
+  // once for all sessions.
+  class FtSession {
+  public:
+    FtSession(const vector<string>& Paths_) :
+      Paths(&Paths_), Data(Paths_.size()), Faces(Paths_.size()), Sizes(Paths_.size()), Active(Paths_.size()) {
+      FtAss(FT_Init_FreeType(&Lib));
+    }
+
+    // Failures here cannot be reported, as a destructor may run while an
+    // error is thrown
+    ~FtSession() {
+      for (auto F : Faces)
+        if (F)
+          FT_Done_Face(F);
+      FT_Done_FreeType(Lib);
+    }
+
+    // False if the face has no glyph for the char
+    bool Load(const FontGlyph& G) {
+      Face = Faces[G.FaceIdx];
+      if (!Face) {
+        auto& File = Data[G.FaceIdx];
+        File = MapShared((*Paths)[G.FaceIdx]);
+        FtAss(FT_New_Memory_Face(Lib, File->Data(), (FT_Long) File->Size(), 0, &Face));
+        Faces[G.FaceIdx] = Face;
+      }
+      auto Px = G.Size * G.Supersample;
+      if (Px != Active[G.FaceIdx]) {
+        auto& Size = Sizes[G.FaceIdx][Px];
+        if (!Size) {
+          FtAss(FT_New_Size(Face, &Size));
+          FtAss(FT_Activate_Size(Size));
+          FtAss(FT_Set_Pixel_Sizes(Face, 0, Px));
+        }
+        else
+          FtAss(FT_Activate_Size(Size));
+        Active[G.FaceIdx] = Px;
+      }
+      auto Key = (uint32_t) G.FaceIdx << 16 | G.Char;
+      auto It = Cmap.find(Key);
+      if (It == Cmap.end())
+        It = Cmap.emplace(Key, FT_Get_Char_Index(Face, G.Char)).first;
+      if (!It->second)
+        return false;
+      FtAss(FT_Load_Glyph(Face, It->second, LoadFlags(G)));
+      return true;
+    }
+
+    FT_GlyphSlot Slot() const noexcept { return Face->glyph; }
+    FT_Library Library() const noexcept { return Lib; }
+    const string& Path(int32_t FaceIdx) const noexcept { return (*Paths)[FaceIdx]; }
+  private:
+    const vector<string>* Paths;
+    vector<shared_ptr<const MappedFile>> Data; // outlives the faces on it
+    FT_Library Lib{};
+    vector<FT_Face> Faces;
+    vector<unordered_map<uint32_t, FT_Size>> Sizes; // by pixel size
+    vector<uint32_t> Active;                        // pixel size of each face
+    unordered_map<uint32_t, FT_UInt> Cmap;         // by face and char
+    FT_Face Face{};
+  };
+
+  // Bitmap box of a loaded glyph, in pixels after downsampling by K
+  struct GlyphBox {
+    int32_t Left;
+    int32_t Top;
+    int32_t W;
+    int32_t H;
+  };
+
+  GlyphBox SlotBox(FT_GlyphSlot Ftg) {
+    return {Ftg->bitmap_left, Ftg->bitmap_top, (int32_t) Ftg->bitmap.width, (int32_t) Ftg->bitmap.rows};
+  }
+
+  // Box of a glyph loaded at K times the size, after downsampling by K
+  GlyphBox Downscaled(const GlyphBox& Box, int32_t K) {
+    auto [Left, Top, W, H] = Box;
+    if (K == 1)
+      return Box;
+    // Aligned to the K x K grid of the target pixels
+    auto L = Left >= 0 ? Left / K : -((K - 1 - Left) / K);
+    auto T = Top >= 0 ? (Top + K - 1) / K : -(-Top / K);
+    return {L, T, (Left - L * K + W + K - 1) / K, (T * K - Top + H + K - 1) / K};
+  }
+
+  GlyphBox SlotBox(FT_GlyphSlot Ftg, int32_t K) {
+    return Downscaled(SlotBox(Ftg), K);
+  }
+
+  // Glyphs of a config are checked before they are loaded
+  void CheckGlyph(const FontGlyph& G, size_t NFace) {
+    if (G.FaceIdx < 0)
+      Abort("No font face specified for char (%u)", G.Char);
+    if ((size_t) G.FaceIdx >= NFace)
+      Abort("Face index for char (%u) is too large: %d > %zu", G.Char, G.FaceIdx, NFace);
+    if (!G.Size)
+      Abort("The size of char (%u) should not be 0", G.Char);
+    if (!G.Supersample || G.Supersample > 16)
+      Abort("The supersampling factor of char (%u) should be in [1, 16] instead of %u", G.Char, G.Supersample);
+  }
+
+  // Copies a FreeType bitmap into Cov at (X, Y), cropped as Coverage::Draw
+  // does. Ch: the char of the glyph, for the diagnostics.
+  void Blit(BitmapView<uint8_t> Cov, const FT_Bitmap& Ftb, bool Mono, int32_t X, int32_t Y, uint32_t Ch,
+    Diagnostics& Diag) {
+    auto XD = X < 0 ? 0 : X;
+    auto YD = Y < 0 ? 0 : Y;
+    auto XS = X < 0 ? -X : 0;
+    auto YS = Y < 0 ? -Y : 0;
+    auto W = min((int32_t) Cov.Width() - XD, (int32_t) Ftb.width - XS);
+    auto H = min((int32_t) Cov.Height() - YD, (int32_t) Ftb.rows - YS);
+    if (W <= 0 || H <= 0) {
+      Diag.Add(DiagKind::NotDrawn, Ch);
+      return;
+    }
+    if (W != (int32_t) Ftb.width || H != (int32_t) Ftb.rows)
+      Diag.Add(DiagKind::Cropped, Ch);
+    for (auto y = 0; y < H; ++y) {
+      auto Src = Ftb.buffer + (ptrdiff_t) (y + YS) * Ftb.pitch;
+      auto Dst = Cov[y + YD] + XD;
+      if (!Mono)
+        copy_n(Src + XS, W, Dst);
+      else
+        for (auto x = 0; x < W; ++x) {
+          auto j = x + XS;
+          Dst[x] = Src[j >> 3] & (1u << ((j & 7) ^ 7)) ? 255 : 0;
+        }
+    }
+  }
+
+  // HeightOf: bitmap height of a glyph, which may not be rendered yet
+  template<class HeightFn>
+  void FillTbl(const Font& Fnt, FontTable& Tbl, HeightFn&& HeightOf) {
+    auto& Glyphs = Fnt.Glyphs;
+    auto NChar = 0u;
+    for (auto Ch = 0u; Ch < Glyphs.size(); ++Ch)
+      if (Glyphs[Ch])
+        ++NChar;
+    Tbl.Hdr.Sign = TblSign;
+    Tbl.Hdr.One = 1;
+    Tbl.Hdr.UnkHZ = Fnt.UnkHZ;
+    Tbl.Hdr.NChar = Cast<uint16_t>(NChar, "Too many chars (%u)", NChar);
+    Tbl.Hdr.LnSpacing = Fnt.LnSpacing;
+    Tbl.Hdr.CapHeight = Fnt.CapHeight;
+    Tbl.Chrs.reset(new TblChar[NChar]);
+    auto Id = 0u;
+    for (auto Ch = 0u; Ch < Glyphs.size(); ++Ch)
+      if (Glyphs[Ch]) {
+        auto& C = Tbl.Chrs[Id];
+        auto& G = Glyphs[Ch];
+        if (!G->HasBmp)
+          Abort("No bitmap for char (%u)", Ch);
+        C.Char = G->Char;
+        C.UnkCZ1 = 0;
+        C.Width = Cast<uint8_t>(G->Advance, "The advance of char (%u) is too large (%u)", Ch, G->Advance);
+        auto H = (size_t) HeightOf(*G);
+        C.Height = Cast<uint8_t>(H, "The height of char (%u) is too large (%zu)", Ch, H);
+        C.UnkTwo = G->UnkTwo;
+        C.UnkCZ2 = 0;
+        C.Dc6Index = G->Valid == true ? (uint16_t) Id : (uint16_t) 0;
+        C.ZPad1 = 0;
+        C.ZPad2 = 0;
+        ++Id;
+      }
+    Assert(Id == NChar);
+  }
+
+  template<class Spr>
+  void FromTbl(Font& Fnt, Spr& S, FontTable& Tbl) {
+    if (S.NDir() != 1)
+      Abort("The number of directions should be 1 instead of %zu", S.NDir());
+    if (Tbl.Hdr.NChar != S.NFrm())
+      Abort("The number of images (%zu) should be the same with characters (%u)", S.NFrm(), Tbl.Hdr.NChar);
+    Fnt.Clear();
+    Fnt.Size = Tbl.Hdr.LnSpacing;
+    Fnt.LnSpacing = Tbl.Hdr.LnSpacing;
+    Fnt.CapHeight = Tbl.Hdr.CapHeight;
+    Fnt.UnkHZ = Tbl.Hdr.UnkHZ;
+    for (auto i = 0u; i < S.NFrm(); ++i) {
+      auto& C = Tbl.Chrs[i];
+      auto& G = Fnt.Glyphs[C.Char];
+      Assert(!G);
+      G.reset(new FontGlyph);
+      G->Char = C.Char;
+      G->Size = Tbl.Hdr.LnSpacing;
+      G->UnkTwo = C.UnkTwo;
+      G->Dc6Index = C.Dc6Index;
+      G->HasBmp = 2;
+      G->BearY = C.Height;
+      G->Advance = C.Width;
+      if (C.Dc6Index >= S.NFrm())
+        Abort("DC6 index (%u) is too large for char (%u): should be less than %zu", C.Dc6Index, G->Char, S.NFrm());
+    }
   }
 }
 
-void Font::RenderGlyphs() {
+void Font::FromSprTbl(CovSprite& Spr, FontTable& Tbl) {
+  FromTbl(*this, Spr, Tbl);
+  for (auto& G : Glyphs)
+    if (G)
+      G->Bmp = Spr[0][G->Dc6Index];
+}
+
+void Font::FromSprTbl(LazySprite& Spr, FontTable& Tbl) {
+  FromTbl(*this, Spr, Tbl);
+  Lazy = &Spr;
+}
+
+// A glyph as loaded for planning. Outlines are moved so that the bottom left
+// of their bitmap box is at the origin, as FT_Render_Glyph moves them.
+struct GlyphShape {
+  GlyphBox Box; // bitmap box at the loaded size
+  vector<FT_Vector> Points;
+  vector<char> Tags;
+  vector<remove_pointer_t<decltype(FT_Outline::contours)>> Contours;
+  int Flags{};
+  // Of a bitmap glyph, on Pixels
+  FT_Bitmap Bmp{};
+  vector<uint8_t> Pixels;
+
+  bool IsOutline() const noexcept { return !Bmp.buffer; }
+};
+
+namespace {
+  // Overlapping outlines are not kept, as FT_Render_Glyph oversamples them
+  // and FT_Outline_Get_Bitmap does not
+  shared_ptr<const GlyphShape> ShapeOf(FT_GlyphSlot Ftg) {
+    auto S = make_shared<GlyphShape>();
+    S->Box = SlotBox(Ftg);
+    if (Ftg->format == FT_GLYPH_FORMAT_BITMAP && Ftg->bitmap.pitch > 0) {
+      auto& B = Ftg->bitmap;
+      S->Pixels.assign(B.buffer, B.buffer + (size_t) B.pitch * B.rows);
+      S->Bmp = B;
+      S->Bmp.buffer = S->Pixels.data();
+    }
+    else if (Ftg->format == FT_GLYPH_FORMAT_OUTLINE && !(Ftg->outline.flags & FT_OUTLINE_OVERLAP)) {
+      auto& O = Ftg->outline;
+      auto Dx = (FT_Pos) S->Box.Left * 64;
+      auto Dy = (FT_Pos) (S->Box.Top - S->Box.H) * 64;
+      S->Points.resize(O.n_points);
+      for (auto i = 0; i < O.n_points; ++i)
+        S->Points[i] = {O.points[i].x - Dx, O.points[i].y - Dy};
+      S->Tags.assign(O.tags, O.tags + O.n_points);
+      S->Contours.assign(O.contours, O.contours + O.n_contours);
+      S->Flags = O.flags;
+    }
+    else
+      return nullptr;
+    return S;
+  }
+
+  // Renders the outline of S into Ftb, moved by (Dx, Dy) pixels. Pts: for
+  // the moved points.
+  void RenderOutline(FT_Library Lib, const GlyphShape& S, const FT_Bitmap& Ftb, int32_t Dx, int32_t Dy,
+    vector<FT_Vector>& Pts) {
+    Pts.resize(S.Points.size());
+    for (auto i = size_t{0}; i < Pts.size(); ++i)
+      Pts[i] = {S.Points[i].x + (FT_Pos) Dx * 64, S.Points[i].y + (FT_Pos) Dy * 64};
+    FT_Outline O{};
+    O.n_contours = (decltype(O.n_contours)) S.Contours.size();
+    O.n_points = (decltype(O.n_points)) Pts.size();
+    O.points = Pts.data();
+    O.tags = const_cast<char*>(S.Tags.data());
+    O.contours = const_cast<decltype(O.contours)>(S.Contours.data());
+    O.flags = S.Flags;
+    FtAss(FT_Outline_Get_Bitmap(Lib, &O, &Ftb));
+  }
+
+  // Renders the outline of S at (X, Y) of Cov, cropped as Coverage::Draw
+  // does, with no bitmap in between. Cov is left as it is outside the glyph.
+  void DrawOutline(FT_Library Lib, const GlyphShape& S, BitmapView<uint8_t> Cov, int32_t X, int32_t Y,
+    uint32_t Ch, Diagnostics& Diag, vector<FT_Vector>& Pts) {
+    auto X0 = max(X, 0);
+    auto Y0 = max(Y, 0);
+    auto X1 = min(X + S.Box.W, (int32_t) Cov.Width());
+    auto Y1 = min(Y + S.Box.H, (int32_t) Cov.Height());
+    if (X1 <= X0 || Y1 <= Y0) {
+      Diag.Add(DiagKind::NotDrawn, Ch);
+      return;
+    }
+    if (X1 - X0 != S.Box.W || Y1 - Y0 != S.Box.H)
+      Diag.Add(DiagKind::Cropped, Ch);
+    // The window of Cov the glyph covers, its bottom left being the origin
+    FT_Bitmap Ftb{};
+    Ftb.rows = (unsigned) (Y1 - Y0);
+    Ftb.width = (unsigned) (X1 - X0);
+    Ftb.pitch = (int) Cov.Stride();
+    Ftb.buffer = Cov[Y0] + X0;
+    Ftb.num_grays = 256;
+    Ftb.pixel_mode = FT_PIXEL_MODE_GRAY;
+    RenderOutline(Lib, S, Ftb, X - X0, Y1 - (Y + S.Box.H), Pts);
+  }
+}
+
+struct GlyphRaster::State {
+  FtSession Ft;
+  vector<uint8_t> FltBuf;
+  vector<uint16_t> SsBuf;
+  Coverage SsCov;
+  vector<FT_Vector> Pts;
+  vector<uint8_t> ShapeBuf; // a shape rendered whole
+
+  State(const vector<string>& Faces) : Ft(Faces) {}
+};
+
+GlyphRaster::GlyphRaster(const vector<string>& Faces) : St(new State(Faces)) {}
+
+GlyphRaster::~GlyphRaster() = default;
+
+void GlyphCache::Clear() {
+  lock_guard<mutex> Lock(Mtx);
+  Rasters.clear();
+}
+
+size_t GlyphCache::Count() const {
+  lock_guard<mutex> Lock(Mtx);
+  return Rasters.size();
+}
+
+void GlyphCache::ResetStats() noexcept {
+  NHit = 0;
+  NMiss = 0;
+}
+
+const Coverage* GlyphCache::Find(const Key& K) {
+  lock_guard<mutex> Lock(Mtx);
+  auto It = Rasters.find(K);
+  ++(It != Rasters.end() ? NHit : NMiss);
+  return It != Rasters.end() ? &It->second : nullptr;
+}
+
+const Coverage& GlyphCache::Add(const Key& K, const Coverage& Cov) {
+  lock_guard<mutex> Lock(Mtx);
+  return Rasters.try_emplace(K, Cov).first->second;
+}
+
+void GlyphRaster::Render(const GlyphPlan& P, const CovFilter& Filter, Diagnostics& Diag, GlyphCache* Cache) {
+  auto G = P.G;
+  if (!Cache)
+    Rasterize(P, Diag);
+  else {
+    // The raster is kept at the size of its box, then placed as planned,
+    // which crops it as rasterizing into the plan would
+    GlyphCache::Key K{St->Ft.Path(G->FaceIdx), G->Size, G->Supersample, G->AntiAliasing, G->Char};
+    auto Tight = Cache->Find(K);
+    if (!Tight) {
+      GlyphBox Box;
+      if (P.Shape)
+        Box = Downscaled(P.Shape->Box, (int32_t) G->Supersample);
+      else {
+        Assert(St->Ft.Load(*G));
+        Box = SlotBox(St->Ft.Slot(), (int32_t) G->Supersample);
+      }
+      Rasterize({G, 0, 0, (uint32_t) max(Box.W, 0), (uint32_t) max(Box.H, 0), P.Shape}, Diag);
+      Tight = &Cache->Add(K, G->Bmp);
+    }
+    G->Bmp.Resize(P.W, P.H);
+    G->Bmp.Fill(0);
+    G->Bmp.Draw(*Tight, P.X, P.Y, Diag, G->Char);
+  }
+  // Padding is transparent, so filtering the padded bitmap is the same
+  if (G->AntiAliasing && !Filter.Empty())
+    Filter.Apply(G->Bmp, St->FltBuf);
+}
+
+void GlyphRaster::Rasterize(const GlyphPlan& P, Diagnostics& Diag) {
+  auto G = P.G;
+  G->Bmp.Resize(P.W, P.H);
+  G->Bmp.Fill(0);
+  auto K = (int32_t) G->Supersample;
+  auto Shape = P.Shape.get();
+  auto Lib = St->Ft.Library();
+  if (Shape && Shape->IsOutline() && K == 1 && G->AntiAliasing) {
+    DrawOutline(Lib, *Shape, G->Bmp, P.X, P.Y, G->Char, Diag, St->Pts);
+    return;
+  }
+  // Others are rendered whole, then copied or downsampled
+  GlyphBox Raw;
+  FT_Bitmap Ftb;
+  if (!Shape) {
+    Assert(St->Ft.Load(*G));
+    auto Ftg = St->Ft.Slot();
+    if (Ftg->format != FT_GLYPH_FORMAT_BITMAP)
+      FtAss(FT_Render_Glyph(Ftg, K > 1 || G->AntiAliasing ? FT_RENDER_MODE_NORMAL : FT_RENDER_MODE_MONO));
+    Raw = SlotBox(Ftg);
+    Ftb = Ftg->bitmap;
+  }
+  else if (!Shape->IsOutline()) {
+    Raw = Shape->Box;
+    Ftb = Shape->Bmp;
+  }
+  else {
+    // Supersampled glyphs are always grayscale, see LoadFlags
+    auto Mono = K == 1;
+    Raw = Shape->Box;
+    Ftb = {};
+    Ftb.rows = (unsigned) Raw.H;
+    Ftb.width = (unsigned) Raw.W;
+    Ftb.pitch = Mono ? (Raw.W + 7) / 8 : Raw.W;
+    Ftb.num_grays = Mono ? 2 : 256;
+    Ftb.pixel_mode = Mono ? FT_PIXEL_MODE_MONO : FT_PIXEL_MODE_GRAY;
+    St->ShapeBuf.assign((size_t) Ftb.pitch * Ftb.rows, 0);
+    Ftb.buffer = St->ShapeBuf.data();
+    RenderOutline(Lib, *Shape, Ftb, 0, 0, St->Pts);
+  }
+  if (K > 1) {
+    auto Src = Downscaled(Raw, K);
+    auto OffX = (uint32_t) (Raw.Left - Src.Left * K);
+    auto OffY = (uint32_t) (Src.Top * K - Raw.Top);
+    // Uncropped glyphs are downsampled in place, others through SsCov
+    auto InPlace = P.X >= 0 && P.Y >= 0 && (uint32_t) (P.X + Src.W) <= P.W && (uint32_t) (P.Y + Src.H) <= P.H;
+    auto Cov = InPlace ? BitmapView<uint8_t>(G->Bmp).Sub(P.X, P.Y, Src.W, Src.H) : BitmapView<uint8_t>{};
+    if (InPlace)
+      Downsample(Cov, Ftb.buffer, Ftb.pitch, Ftb.width, Ftb.rows, OffX, OffY, K, St->SsBuf);
+    else {
+      Downsample(St->SsCov, Ftb.buffer, Ftb.pitch, Ftb.width, Ftb.rows, OffX, OffY, K, St->SsBuf);
+      Cov = St->SsCov;
+    }
+    if (!G->AntiAliasing)
+      for (auto y = size_t{0}; y < Cov.Height(); ++y)
+        for (auto x = size_t{0}; x < Cov.Width(); ++x)
+          Cov[y][x] = Cov[y][x] & 0x80 ? 255 : 0;
+    if (!InPlace)
+      G->Bmp.Draw(Cov, P.X, P.Y, Diag, G->Char);
+  }
+  else
+    Blit(G->Bmp, Ftb, !G->AntiAliasing, P.X, P.Y, G->Char, Diag);
+}
+
+vector<GlyphPlan> Font::PlanGlyphs() {
+  GlyphRaster Raster(Faces);
+  return PlanGlyphs(Raster);
+}
+
+vector<GlyphPlan> Font::PlanGlyphs(GlyphRaster& Raster) {
   vector<FontGlyph*> ToRender;
   for (auto Ch = 0u; Ch < Glyphs.size(); ++Ch) {
     auto& G = Glyphs[Ch];
@@ -55,136 +486,358 @@ void Font::RenderGlyphs() {
     Assert(G->Char == Ch);
     if (G->HasBmp)
       continue;
-    if (G->FaceIdx < 0)
-      Abort("No font face specified for char (%u)", Ch);
-    if ((size_t) G->FaceIdx >= Faces.size())
-      Abort("Face index for char (%u) is too large: %d > %zu", Ch, G->FaceIdx, Faces.size());
-    if (!Glyphs[Ch]->Size)
-      Abort("The size of char (%u) should not be 0", Ch);
+    CheckGlyph(*G, Faces.size());
     ToRender.emplace_back(Glyphs[Ch].get());
   }
-  sort(ToRender.begin(), ToRender.end(),
-    [](FontGlyph* A, FontGlyph* B) {
-      return A->FaceIdx != B->FaceIdx ? A->FaceIdx < B->FaceIdx : A->Size < B->Size;
-    }
-  );
-  int32_t LastFace{-1};
-  uint32_t LastSize{};
-  FT_Library Lib{};
-  FtAss(FT_Init_FreeType(&Lib));
-  FT_Face Face{};
-  for (auto& G : ToRender) {
-    if (G->FaceIdx != LastFace) {
-      if (Face)
-        FtAss(FT_Done_Face(Face));
-      FtAss(FT_New_Face(Lib, Faces[G->FaceIdx].c_str(), 0, &Face));
-      LastFace = G->FaceIdx;
-      LastSize = 0;
-    }
-    if (G->Size != LastSize) {
-      FtAss(FT_Set_Pixel_Sizes(Face, 0, G->Size));
-      LastSize = G->Size;
-    }
-    auto FtgIdx = FT_Get_Char_Index(Face, G->Char);
-    if (!FtgIdx) {
-      Warn("No glyph found for char (%u), a dummy (1x1) bitmap will be generated", G->Char);
+  auto& Ft = Raster.St->Ft;
+  // Metrics only: FreeType presets the bitmap box when loading a glyph, so
+  // nothing is rasterized until the padding of every glyph is known. The
+  // glyphs are kept as loaded, to be rasterized without loading them again.
+  vector<GlyphBox> Boxes(ToRender.size());
+  vector<shared_ptr<const GlyphShape>> Shapes(ToRender.size());
+  auto MaxDescent = int32_t{};
+  for (auto i = size_t{0}; i < ToRender.size(); ++i) {
+    auto G = ToRender[i];
+    if (!Ft.Load(*G)) {
+      Diag->Add(DiagKind::NoGlyph, G->Char);
       G->Valid = false;
       G->BearX = 0;
       G->BearY = 1;
       G->Advance = 1;
       G->HasBmp = 1;
       G->Bmp.Resize(1, 1);
-      G->Bmp.Fill({});
+      G->Bmp.Fill(0);
+      continue;
     }
-    else {
-      FtAss(FT_Load_Glyph(Face, FtgIdx, G->AntiAliasing ? FT_LOAD_DEFAULT : FT_LOAD_TARGET_MONO | FT_LOAD_MONOCHROME));
-      if (Face->glyph->format != FT_GLYPH_FORMAT_BITMAP)
-        FtAss(FT_Render_Glyph(Face->glyph, G->AntiAliasing ? FT_RENDER_MODE_NORMAL : FT_RENDER_MODE_MONO));
-      auto& Ftg = Face->glyph;
-      auto& Ftb = Face->glyph->bitmap;
-      if (!Ftb.width || !Ftb.rows) {
-        Warn("Empty bitmap generated for char (%u), a dummy (1x1) bitmap will be generated", G->Char);
-        G->Valid = false;
-        G->BearX = 0;
-        G->BearY = 1;
-        G->Advance = Ftg->advance.x >> 6;
-        G->HasBmp = 1;
-        G->Bmp.Resize(1, 1);
-        G->Bmp.Fill({});
-      }
-      else {
-        G->BearX = Ftg->bitmap_left;
-        G->BearY = Ftg->bitmap_top;
-        G->Advance = Ftg->advance.x >> 6;
-        G->HasBmp = 2;
-        G->Bmp.Resize(Ftb.width, Ftb.rows);
-        if (G->AntiAliasing) {
-          for (auto i = 0u; i < Ftb.rows; ++i)
-            for (auto j = 0u; j < Ftb.width; ++j) {
-              auto Col = Ftb.buffer[i * Ftb.pitch + j];
-              G->Bmp[i][j].R = Col;
-              G->Bmp[i][j].G = Col;
-              G->Bmp[i][j].B = Col;
-#ifdef BMP_ALPHA
-              G->Bmp[i][j].A = Col ? 255 : 0;
-#endif
-            }
-        }
-        else {
-          for (auto i = 0u; i < Ftb.rows; ++i)
-            for (auto j = 0u; j < Ftb.width; ++j) {
-              auto Col = Ftb.buffer[i * Ftb.pitch + (j >> 3)] & (1u << ((j & 7) ^ 7));
-              G->Bmp[i][j].R = Col ? 255 : 0;
-              G->Bmp[i][j].G = Col ? 255 : 0;
-              G->Bmp[i][j].B = Col ? 255 : 0;
-#ifdef BMP_ALPHA
-              G->Bmp[i][j].A = Col ? 255 : 0;
-#endif
-            }
-        }
-      }
+    auto Ftg = Ft.Slot();
+    auto K = (int32_t) G->Supersample;
+    if (!Ftg->bitmap.width || !Ftg->bitmap.rows) {
+      Diag->Add(DiagKind::EmptyGlyph, G->Char);
+      G->Valid = false;
+      G->BearX = 0;
+      G->BearY = 1;
+      G->Advance = ScaleAdvance(Ftg->advance.x, K);
+      G->HasBmp = 1;
+      G->Bmp.Resize(1, 1);
+      G->Bmp.Fill(0);
+      continue;
     }
+    auto& Box = Boxes[i];
+    Box = SlotBox(Ftg, K);
+    Shapes[i] = ShapeOf(Ftg);
+    G->BearX = Box.Left;
+    G->BearY = Box.Top;
+    G->Advance = ScaleAdvance(Ftg->advance.x, K);
+    G->HasBmp = 2;
+    MaxDescent = max(MaxDescent, Box.H - Box.Top);
   }
-  if (Face)
-    FtAss(FT_Done_Face(Face));
-  FtAss(FT_Done_FreeType(Lib));
-  auto MaxDescent = int32_t{};
-  for (auto& G : ToRender)
-    if (G->HasBmp == 2)
-      MaxDescent = max(MaxDescent, G->Descent());
-  auto MaxPadding = ~DescentPadding ? DescentPadding : MaxDescent + OriginOffset + DescentOffset;
+  // Each glyph is rasterized straight into its padded bitmap
+  auto MaxPadding = PaddedDescent(MaxDescent);
   auto MaxH = size_t{};
-  for (auto& G : ToRender) {
+  vector<GlyphPlan> Plans;
+  for (auto i = size_t{0}; i < ToRender.size(); ++i) {
+    auto G = ToRender[i];
     if (G->HasBmp != 2)
       continue;
     if (G->BearX < 0) {
-      Warn("BearX is negative (%d) for char (%u), set it to 0", G->BearX, G->Char);
+      Diag->Add(DiagKind::NegBearX, G->Char);
       G->BearX = 0;
     }
-    if (G->BearX || G->Descent() != MaxPadding) {
-      auto W = G->BearX + (int32_t) G->Bmp.Width();
+    auto& Box = Boxes[i];
+    GlyphPlan P{G, 0, 0, (uint32_t) Box.W, (uint32_t) Box.H};
+    if (G->BearX || Box.H - Box.Top != MaxPadding) {
+      auto W = G->BearX + Box.W;
       auto H = G->BearY + MaxPadding;
       if (W <= 0 || H <= 0) {
-        Warn("The bitmap of char (%u) is completely cropped out, a dummy (1x1) bitmap will be generated", G->Char);
+        Diag->Add(DiagKind::CroppedOut, G->Char);
+        G->BearX = 0;
+        G->BearY = 1;
         G->HasBmp = 1;
         G->Bmp.Resize(1, 1);
-        G->Bmp.Fill({});
+        G->Bmp.Fill(0);
         continue;
       }
-      auto Bmp = Bitmap(W, H);
-      Bmp.Fill({});
-      Bmp.Draw(G->Bmp, G->BearX, 0 + OriginOffset);
-      G->Bmp = move(Bmp);
+      P = {G, G->BearX, OriginOffset, (uint32_t) W, (uint32_t) H};
     }
-    MaxH = max(MaxH, G->Bmp.Height());
+    // The bearings are in the padded bitmap now, which is placed as FromTbl
+    // places DC6 frames, standing on the baseline
+    G->BearX = 0;
+    G->BearY = (int32_t) P.H;
+    P.Shape = move(Shapes[i]);
+    Plans.emplace_back(move(P));
+    MaxH = max(MaxH, (size_t) P.H);
   }
   if (!LnSpacing)
-    LnSpacing = ceil((float)(MaxH - MaxDescent * 10 / HeightConstant)) + LnSpacingOff;
-    auto ActualSpacing = HeightConstant * LnSpacing / 10;
-  if (ActualSpacing < MaxH)
-    Warn("The maximum height (%zu) of newly generated glyphs is larger than Actual Spacing (%u)", MaxH, ActualSpacing);
+    LnSpacing = LineSpacing(MaxH, MaxDescent, HeightConstant, LnSpacingOff);
+  auto Actual = ActualSpacing(LnSpacing, HeightConstant);
+  if (Actual < MaxH)
+    Warn("The maximum height (%zu) of newly generated glyphs is larger than Actual Spacing (%u)", MaxH, Actual);
   if (!CapHeight)
     CapHeight = 1; // CapHeightOff + (Size / 2);
+  return Plans;
+}
+
+vector<GlyphMetrics> Font::MeasureGlyphs(uint32_t NThread) const {
+  vector<const FontGlyph*> ToLoad;
+  for (auto& G : Glyphs)
+    if (G && !G->HasBmp) {
+      CheckGlyph(*G, Faces.size());
+      ToLoad.emplace_back(G.get());
+    }
+  vector<GlyphMetrics> Res(ToLoad.size());
+  if (!NThread)
+    NThread = max(thread::hardware_concurrency(), 1u);
+  // A session for each thread, as FreeType instances are not shared
+  auto NChunk = max(min((size_t) NThread, ToLoad.size()), size_t{1});
+  ParallelFor(NChunk, NThread, [&](size_t c) {
+    FtSession Ft(Faces);
+    for (auto i = ToLoad.size() * c / NChunk; i < ToLoad.size() * (c + 1) / NChunk; ++i) {
+      auto& G = *ToLoad[i];
+      auto& M = Res[i];
+      M = {G.Char, Ft.Load(G), 0, 0, 0, 0, 0};
+      if (!M.Found)
+        continue;
+      auto Ftg = Ft.Slot();
+      auto K = (int32_t) G.Supersample;
+      M.Advance = ScaleAdvance(Ftg->advance.x, K);
+      if (!Ftg->bitmap.width || !Ftg->bitmap.rows)
+        continue;
+      auto Box = SlotBox(Ftg, K);
+      M.Left = Box.Left;
+      M.Top = Box.Top;
+      M.W = Box.W;
+      M.H = Box.H;
+    }
+  });
+  return Res;
+}
+
+int32_t Font::PaddedDescent(int32_t MaxDescent) const noexcept {
+  return ~DescentPadding ? DescentPadding : MaxDescent + OriginOffset + DescentOffset;
+}
+
+uint32_t Font::LineSpacing(size_t MaxH, int32_t MaxDescent, int32_t HeightConstant, int32_t LnSpacingOff) {
+  return ceil((float)(MaxH - MaxDescent * 10 / HeightConstant)) + LnSpacingOff;
+}
+
+uint32_t Font::ActualSpacing(uint32_t LnSpacing, int32_t HeightConstant) noexcept {
+  return HeightConstant * LnSpacing / 10;
+}
+
+void Font::RenderGlyphs() {
+  GlyphRaster Raster(Faces);
+  for (auto& P : PlanGlyphs(Raster))
+    Raster.Render(P, Filter, *Diag, Cache);
+}
+
+void Font::DeferGlyphs() {
+  if (!Raster)
+    Raster.reset(new GlyphRaster(Faces));
+  // Few of them are ever rasterized, so they are loaded again rather than
+  // all kept as loaded
+  for (auto& P : PlanGlyphs(*Raster)) {
+    P.Shape.reset();
+    Deferred.emplace(P.G->Char, move(P));
+  }
+}
+
+void Font::Build(const char* Dc6Path, FontTable& Tbl, CovRamps& Ramps, int32_t Dc6OffsetY, uint32_t NThread) {
+  BuildFamily({{this, Dc6Path, &Tbl, Dc6OffsetY}}, Ramps, NThread);
+}
+
+void Font::BuildFamily(const vector<FontBuild>& Builds, CovRamps& Ramps, uint32_t NThread) {
+  if (Builds.empty())
+    return;
+  auto& Faces = Builds[0].Fnt->Faces;
+  for (auto& Bld : Builds)
+    if (Bld.Fnt->Faces != Faces)
+      Abort("The fonts built together should be on the same faces");
+  struct Job {
+    Font* Fnt;
+    vector<GlyphPlan> Plans;
+    vector<GlyphPlan*> PlanOf;
+    vector<FontGlyph*> ByChar;
+    vector<uint16_t> Ramp;
+
+    // The sizes of all bitmaps are known from the plans, so the TBL is done
+    // before anything is rendered, and bitmaps can be dropped once encoded
+    pair<uint32_t, uint32_t> Dims(const FontGlyph& G) const {
+      if (auto P = PlanOf[G.Char])
+        return {P->W, P->H};
+      return {(uint32_t) G.Bmp.Width(), (uint32_t) G.Bmp.Height()};
+    }
+  };
+  // Chars [Beg, End) of a job
+  struct Span {
+    size_t IJob;
+    size_t Beg;
+    size_t End;
+  };
+  // The fonts are planned in turn on one session, sharing its faces and
+  // glyph indices
+  constexpr size_t BatchSize = 64;
+  vector<Job> Jobs(Builds.size());
+  vector<Span> Spans;
+  {
+    GlyphRaster Planner(Faces);
+    for (auto i = size_t{0}; i < Builds.size(); ++i) {
+      auto& J = Jobs[i];
+      J.Fnt = Builds[i].Fnt;
+      J.Plans = J.Fnt->PlanGlyphs(Planner);
+      J.PlanOf.resize(J.Fnt->Glyphs.size());
+      for (auto& P : J.Plans)
+        J.PlanOf[P.G->Char] = &P;
+      // Ramps are not thread safe, so all of them are created up front
+      for (auto& G : J.Fnt->Glyphs)
+        if (G) {
+          if (!G->HasBmp)
+            Abort("No bitmap for char (%u)", G->Char);
+          J.ByChar.emplace_back(G.get());
+          J.Ramp.emplace_back(Ramps.Find(G->FgCol, G->BgCol));
+        }
+      FillTbl(*J.Fnt, *Builds[i].Tbl, [&](const FontGlyph& G) { return J.Dims(G).second; });
+      for (auto Beg = size_t{0}; Beg < J.ByChar.size(); Beg += BatchSize)
+        Spans.push_back({i, Beg, min(J.ByChar.size(), Beg + BatchSize)});
+    }
+  }
+  if (!NThread)
+    NThread = max(thread::hardware_concurrency(), 1u);
+  // Render -> encode -> write, one batch of chars at a time in each stage.
+  // Batches of all the fonts share the stages, so the threads are kept busy
+  // across the fonts. At most Window batches are in flight, the writer puts
+  // them in order.
+  auto NBatch = Spans.size();
+  auto Window = (size_t) NThread * 2 + 2;
+  struct Batch {
+    size_t Seq;
+    string Rle;
+    vector<size_t> Ends; // of each frame in Rle
+  };
+  BoundedQueue<Batch> ToEncode(Window);
+  BoundedQueue<Batch> ToWrite(Window);
+  atomic<size_t> NextSeq{0};
+  mutex Mtx;
+  condition_variable Cv;
+  auto NWritten = size_t{0};
+  // A failed stage stops the others, so that all the threads can be joined
+  ErrorSlot Errs;
+  auto Fail = [&](exception_ptr Err) {
+    Errs.Set(Err);
+    ToEncode.Close();
+    ToWrite.Close();
+    lock_guard<mutex> Lock(Mtx);
+    Cv.notify_all();
+  };
+  vector<thread> Renderers;
+  for (auto i = 0u; i < NThread; ++i)
+    Renderers.emplace_back([&] {
+      try {
+        GlyphRaster Raster(Faces);
+        for (;;) {
+          auto Seq = NextSeq++;
+          if (Seq >= NBatch)
+            break;
+          {
+            unique_lock<mutex> Lock(Mtx);
+            Cv.wait(Lock, [&] { return Seq < NWritten + Window || Errs.Failed(); });
+          }
+          if (Errs.Failed())
+            break;
+          auto& Sp = Spans[Seq];
+          auto& J = Jobs[Sp.IJob];
+          for (auto j = Sp.Beg; j < Sp.End; ++j)
+            if (auto P = J.PlanOf[J.ByChar[j]->Char]) {
+              Raster.Render(*P, J.Fnt->Filter, *J.Fnt->Diag, J.Fnt->Cache);
+              P->Shape.reset();
+            }
+          ToEncode.Push({Seq, {}, {}});
+        }
+      }
+      catch (...) {
+        Fail(current_exception());
+      }
+    });
+  vector<thread> Encoders;
+  for (auto i = 0u; i < max(NThread / 4, 1u); ++i)
+    Encoders.emplace_back([&] {
+      try {
+        Batch B;
+        while (ToEncode.Pop(B)) {
+          auto& Sp = Spans[B.Seq];
+          auto& J = Jobs[Sp.IJob];
+          for (auto j = Sp.Beg; j < Sp.End; ++j) {
+            auto G = J.ByChar[j];
+            EncodeDc6(B.Rle, G->Bmp, Ramps[J.Ramp[j]]);
+            B.Ends.emplace_back(B.Rle.size());
+            if (J.PlanOf[G->Char])
+              G->Bmp = Coverage{};
+          }
+          ToWrite.Push(move(B));
+        }
+      }
+      catch (...) {
+        Fail(current_exception());
+      }
+    });
+  // The DC6 files are written one after another, each in one go
+  Dc6Writer Writer;
+  auto IOpen = size_t{0};
+  auto Next = [&](size_t IJob) {
+    for (; IOpen < IJob; ++IOpen) {
+      Writer.Close();
+      Writer.Open(Builds[IOpen + 1].Dc6Path, 1, Jobs[IOpen + 1].ByChar.size());
+    }
+  };
+  try {
+    Writer.Open(Builds[0].Dc6Path, 1, Jobs[0].ByChar.size());
+    map<size_t, Batch> Pending;
+    Batch B;
+    while (NWritten < NBatch && ToWrite.Pop(B)) {
+      Pending.emplace(B.Seq, move(B));
+      for (auto It = Pending.begin(); It != Pending.end() && It->first == NWritten; It = Pending.erase(It)) {
+        auto& Cur = It->second;
+        auto& Sp = Spans[Cur.Seq];
+        auto& J = Jobs[Sp.IJob];
+        Next(Sp.IJob);
+        auto Beg = size_t{0};
+        for (auto j = size_t{0}; j < Cur.Ends.size(); ++j) {
+          auto [W, H] = J.Dims(*J.ByChar[Sp.Beg + j]);
+          Writer.Put(W, H, Builds[Sp.IJob].Dc6OffsetY,
+            string_view(Cur.Rle).substr(Beg, Cur.Ends[j] - Beg));
+          Beg = Cur.Ends[j];
+        }
+        lock_guard<mutex> Lock(Mtx);
+        ++NWritten;
+        Cv.notify_all();
+      }
+    }
+  }
+  catch (...) {
+    Fail(current_exception());
+  }
+  for (auto& T : Renderers)
+    T.join();
+  ToEncode.Close();
+  for (auto& T : Encoders)
+    T.join();
+  Errs.Rethrow();
+  // Fonts after the last batch have no glyphs, but still get their DC6
+  Next(Builds.size() - 1);
+  Writer.Close();
+}
+
+const Coverage& Font::GlyphBmp(const FontGlyph& G) {
+  if (Lazy && G.HasBmp == 2)
+    return Lazy->Frame(0, G.Dc6Index);
+  auto It = Deferred.find(G.Char);
+  if (It != Deferred.end()) {
+    Raster->Render(It->second, Filter, *Diag, Cache);
+    Deferred.erase(It);
+    // Placed as its TBL entry would place its DC6 frame, so that a preview
+    // of the config is the preview of the DC6 and TBL it builds
+    Assert(G.BearX == 0 && G.BearY == (int32_t) G.Bmp.Height());
+  }
+  return G.Bmp;
 }
 
 pair<size_t, size_t> Font::Extent(wstring_view Str) {
@@ -204,69 +857,38 @@ pair<size_t, size_t> Font::Extent(wstring_view Str) {
       continue;
     }
     auto& G = Glyphs[Ch];
-    if (!G->HasBmp)
+    if (!G || !G->HasBmp)
       Abort("No bitmap for char (%d)", (int) Ch);
-    H = max(H, HCur + G->Bmp.Height());
-    XMax = max(XMax, X + G->BearX + G->Bmp.Width());
+    auto& Bmp = GlyphBmp(*G);
+    H = max(H, HCur + Bmp.Height());
+    XMax = max(XMax, X + G->BearX + Bmp.Width());
     X += G->Advance;
   }
   W = max(W, XMax);
   return {W, H};
 }
 
-Bitmap Font::Render(wstring_view Str) {
+Coverage Font::Render(wstring_view Str) {
   auto [W, H] = Extent(Str);
-  auto NLine_ = (int32_t) count(Str.begin(), Str.end(), L'\n');
-  auto X = (int32_t) 0;
-  auto Y = (int32_t) (H - NLine_ * LnSpacing);
-  Bitmap Bmp(W, H);
-  Bmp.Fill({});
-  for (auto Ch : Str) {
-    if (Ch == L'\n') {
-      X = 0u;
-      Y += LnSpacing;
-      continue;
-    }
-    auto& G = Glyphs[Ch];
-    if (!G->HasBmp)
-      Abort("No bitmap for char (%d)", (int) Ch);
-    Bmp.Draw(G->Bmp, X + G->BearX, Y - G->BearY);
-    X += G->Advance;
-  }
+  Coverage Bmp(W, H);
+  Bmp.Fill(0);
+  Layout(Str, H, [&](const FontGlyph& G, int32_t X, int32_t Y) { Bmp.Draw(GlyphBmp(G), X, Y, *Diag, G.Char); });
   return Bmp;
 }
 
-void Font::Dump(Sprite& Spr, FontTable& Tbl) {
-  auto NChar = 0u;
-  for (auto Ch = 0u; Ch < Glyphs.size(); ++Ch)
-    if (Glyphs[Ch])
-      ++NChar;
-  Tbl.Hdr.Sign = TblSign;
-  Tbl.Hdr.One = 1;
-  Tbl.Hdr.UnkHZ = UnkHZ;
-  Tbl.Hdr.NChar = Cast<uint16_t>(NChar, "Too many chars (%u)", NChar);
-  Tbl.Hdr.LnSpacing = LnSpacing;
-  Tbl.Hdr.CapHeight = CapHeight;
-  Tbl.Chrs.reset(new TblChar[NChar]);
-  Spr.Resize(1, NChar);
+void Font::DumpTbl(FontTable& Tbl) {
+  FillTbl(*this, Tbl, [](const FontGlyph& G) { return G.Bmp.Height(); });
+}
+
+void Font::Dump(CovSprite& Spr, FontTable& Tbl, CovRamps& Ramps) {
+  DumpTbl(Tbl);
+  Spr.Resize(1, Tbl.Hdr.NChar);
+  Spr.Ramp.Resize(1, Tbl.Hdr.NChar);
   auto Id = 0u;
-  for (auto Ch = 0u; Ch < Glyphs.size(); ++Ch)
-    if (Glyphs[Ch]) {
-      auto& C = Tbl.Chrs[Id];
-      auto& G = Glyphs[Ch];
-      if (!G->HasBmp)
-        Abort("No bitmap for char (%u)", Ch);
-      C.Char = G->Char;
-      C.UnkCZ1 = 0;
-      C.Width = Cast<uint8_t>(G->Advance, "The advance of char (%u) is too large (%u)", Ch, G->Advance);
-      C.Height = Cast<uint8_t>(G->Bmp.Height(), "The height of char (%u) is too large (%zu)", Ch, G->Bmp.Height());
-      C.UnkTwo = G->UnkTwo;
-      C.UnkCZ2 = 0;
-      C.Dc6Index = G->Valid == true ? (uint16_t) Id : (uint16_t) 0;
-      C.ZPad1 = 0;
-      C.ZPad2 = 0;
+  for (auto& G : Glyphs)
+    if (G) {
       Spr[0][Id] = move(G->Bmp);
+      Spr.Ramp[0][Id] = Ramps.Find(G->FgCol, G->BgCol);
       ++Id;
     }
-  Assert(Id == NChar);
 }
@@ -3,31 +3,121 @@
 #include "Common.hpp"
 
 #include "Bitmap.hpp"
+#include "CovFilter.hpp"
+#include "Coverage.hpp"
 #include "FontTable.hpp"
 #include "Sprite.hpp"
 
+#include <atomic>
+#include <map>
+#include <mutex>
+
 struct FontGlyph {
   // In, not used by TBL/DC6
   uint16_t    Char{};
   bool        AntiAliasing{true};
+  uint32_t    Supersample{1}; // rendered at this times the size, then box filtered
   int32_t     FaceIdx{-1}; // -1: no face
   uint32_t    Size{0};
   Pixel       FgCol{255,255,255};
   Pixel       BgCol{0,0,0};
   // Tbl Specific - also by config
   uint8_t     UnkTwo{1};
+  uint16_t    Dc6Index{}; // frame in Font::Lazy, if any
   // Out
   uint8_t     HasBmp{0}; // 0: no bmp; 1: dummy 1x1; 2: normal
   int32_t     BearX{};
   int32_t     BearY{};
   uint32_t    Advance{};
-  Bitmap      Bmp{};
+  Coverage    Bmp{};
 
   bool        Valid{ true }; // valid glyph
 
   constexpr int32_t Descent() { return (int32_t) Bmp.Height() - BearY; }
 };
 
+struct GlyphShape;
+
+// Where a glyph goes in its bitmap, known before it is rasterized
+struct GlyphPlan {
+  FontGlyph* G;
+  int32_t X; // of the rasterized glyph in its padded bitmap
+  int32_t Y;
+  uint32_t W; // of the padded bitmap
+  uint32_t H;
+  // The glyph as loaded for planning, so that it is not loaded again. None:
+  // loaded again to be rasterized.
+  shared_ptr<const GlyphShape> Shape{};
+};
+
+// Box of a glyph as loaded, in pixels at its size, before any padding
+struct GlyphMetrics {
+  uint16_t Char;
+  bool Found;     // the face has the char
+  int32_t Left;   // BearX
+  int32_t Top;    // BearY, above the baseline
+  int32_t W;      // 0 if the glyph has no pixels
+  int32_t H;
+  uint32_t Advance;
+
+  constexpr int32_t Descent() const noexcept { return H - Top; }
+};
+
+struct Font;
+
+// Glyphs as rasterized, before padding and filtering, kept across builds so
+// that a rebuild after a change of metrics, padding or filter rasterizes
+// only the glyphs it has not seen. The threads of a build share one.
+class GlyphCache {
+public:
+  void Clear();
+
+  size_t Count() const;
+  // Lookups since the last ResetStats
+  size_t Hits() const noexcept { return NHit; }
+  size_t Misses() const noexcept { return NMiss; }
+  void ResetStats() noexcept;
+private:
+  friend class GlyphRaster;
+  // Face path, pixel size, supersampling, anti-aliasing and char
+  using Key = tuple<string, uint32_t, uint32_t, bool, uint16_t>;
+
+  mutable mutex Mtx;
+  map<Key, Coverage> Rasters; // nodes stay in place as others are added
+  atomic<size_t> NHit{0};
+  atomic<size_t> NMiss{0};
+
+  const Coverage* Find(const Key& K);
+  const Coverage& Add(const Key& K, const Coverage& Cov);
+};
+
+// Rasterizer with its own FreeType instance, one for each thread. Fonts on
+// the same faces may share one, whatever their sizes.
+class GlyphRaster {
+public:
+  GlyphRaster(const vector<string>& Faces);
+  ~GlyphRaster();
+
+  // Filter and Diag: of the font of the glyph. Cache: where the raster is
+  // looked up first and kept, if given.
+  void Render(const GlyphPlan& P, const CovFilter& Filter, Diagnostics& Diag, GlyphCache* Cache = nullptr);
+private:
+  friend struct Font;
+  struct State;
+  unique_ptr<State> St;
+
+  // Into P.G->Bmp, unfiltered
+  void Rasterize(const GlyphPlan& P, Diagnostics& Diag);
+};
+
+// Outputs of one font of Font::BuildFamily
+struct FontBuild {
+  Font* Fnt;
+  const char* Dc6Path;
+  FontTable* Tbl;
+  int32_t Dc6OffsetY;
+};
+
 struct Font {
   vector<unique_ptr<FontGlyph>> Glyphs{65536};
   // By Config
@@ -38,20 +128,83 @@ struct Font {
   int32_t CapHeightOff{0};
   int32_t DescentPadding{-1}; // -1 for automatic
   int32_t OriginOffset{ 0 }; // pop
+  CovFilter Filter{};       // applied to anti-aliased glyphs
   // Tbl Specific - also by config
   int32_t DescentOffset{ 0 }; // pop
   int32_t HeightConstant{ 14 }; // 14 ENG 15 JPN 17 CHI
   uint32_t LnSpacing{};
   uint32_t CapHeight{};
   uint16_t UnkHZ{};
+  // Glyph bitmaps are decoded on demand from here, if given
+  LazySprite* Lazy{};
+  // Glyphs planned by DeferGlyphs, rasterized by GlyphBmp on first use
+  unordered_map<uint16_t, GlyphPlan> Deferred{};
+  unique_ptr<GlyphRaster> Raster{};
+  // Rasters kept across builds, if given
+  GlyphCache* Cache{};
+  // Where the warnings about its glyphs go
+  Diagnostics* Diag{&Diags()};
 
   void Clear();
-  void FromSprTbl(Sprite& Spr, FontTable& Tbl);
+  void FromSprTbl(CovSprite& Spr, FontTable& Tbl);
+  void FromSprTbl(LazySprite& Spr, FontTable& Tbl);
   //void ReadYml(const char* Path);
 
+  // Computes the metrics of the glyphs to be rendered and the line spacing,
+  // glyphs without bitmaps get dummies. The glyphs are then placed as their
+  // TBL entries place them: BearX 0 and BearY the padded bitmap height.
+  vector<GlyphPlan> PlanGlyphs();
+  // Same, with the glyphs loaded by Raster, which must be on these faces
+  vector<GlyphPlan> PlanGlyphs(GlyphRaster& Raster);
+  // Metrics of the glyphs to be rendered, loaded on NThread threads (0: one
+  // per core) without rasterizing anything. The glyphs are left as they are.
+  vector<GlyphMetrics> MeasureGlyphs(uint32_t NThread = 0) const;
+  // Descent every glyph bitmap is padded to, given the deepest glyph
+  int32_t PaddedDescent(int32_t MaxDescent) const noexcept;
+  // Line spacing PlanGlyphs sets from the tallest padded bitmap
+  static uint32_t LineSpacing(size_t MaxH, int32_t MaxDescent, int32_t HeightConstant, int32_t LnSpacingOff);
+  // Height of a line in game, which the padded bitmaps should fit in
+  static uint32_t ActualSpacing(uint32_t LnSpacing, int32_t HeightConstant) noexcept;
   void RenderGlyphs();
-  void Dump(Sprite& Spr, FontTable& Tbl);
+  // RenderGlyphs, but only the metrics are computed here, so that a preview
+  // rasterizes just the glyphs it uses
+  void DeferGlyphs();
+  // RenderGlyphs and Dump in overlapping stages, the DC6 is written as glyphs
+  // are rendered. Rendered bitmaps are dropped once encoded, so memory grows
+  // with the number of glyphs only by their outlines, kept from planning
+  // until rasterized. NThread: rasterizer threads, 0 for one per core.
+  void Build(const char* Dc6Path, FontTable& Tbl, CovRamps& Ramps, int32_t Dc6OffsetY, uint32_t NThread = 0);
+  // Build of several fonts on the same faces, such as the sizes of a family,
+  // in one pipeline. The threads open each face once for all the fonts.
+  static void BuildFamily(const vector<FontBuild>& Builds, CovRamps& Ramps, uint32_t NThread = 0);
+  void DumpTbl(FontTable& Tbl);
+  void Dump(CovSprite& Spr, FontTable& Tbl, CovRamps& Ramps);
+
+  const Coverage& GlyphBmp(const FontGlyph& G);
 
   pair<size_t, size_t> Extent(wstring_view Str);
-  Bitmap Render(wstring_view Str);
+  Coverage Render(wstring_view Str);
+  // Calls Put(G, X, Y) for each glyph of Str, where (X, Y) is the top left
+  // of its bitmap in an image of Extent(Str)
+  template<class PutFn>
+  void Layout(wstring_view Str, size_t H, PutFn&& Put);
 };
+
+template<class PutFn>
+void Font::Layout(wstring_view Str, size_t H, PutFn&& Put) {
+  auto NLine_ = (int32_t) count(Str.begin(), Str.end(), L'\n');
+  auto X = (int32_t) 0;
+  auto Y = (int32_t) (H - NLine_ * LnSpacing);
+  for (auto Ch : Str) {
+    if (Ch == L'\n') {
+      X = 0u;
+      Y += LnSpacing;
+      continue;
+    }
+    auto& G = Glyphs[Ch];
+    if (!G || !G->HasBmp)
+      Abort("No bitmap for char (%d)", (int) Ch);
+    Put(*G, X + G->BearX, Y - G->BearY);
+    X += G->Advance;
+  }
+}
@@ -2,6 +2,11 @@
 #include "FontTable.hpp"
 #include "Sprite.hpp"
 
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TBL_SSE2
+#endif
+
 void FontTable::ReadTbl(const char* Path) {
   auto File = AutoFile(Path, "rb");
   File.Get(&Hdr, 1);
@@ -41,3 +46,72 @@ void FontTable::SaveTbl(const char* Path) {
   File.Put(Hdr);
   File.Put(Chrs.get(), Hdr.NChar);
 }
+
+void TblMetrics::FromTbl(const FontTable& Tbl) {
+  Adv.fill(0);
+  Hgt.fill(0);
+  Has.fill(0);
+  for (auto i = 0u; i < Tbl.Hdr.NChar; ++i) {
+    auto& C = Tbl.Chrs[i];
+    Adv[C.Char] = C.Width;
+    Hgt[C.Char] = C.Height;
+    Has[C.Char] = 1;
+  }
+  LnSpacing = Tbl.Hdr.LnSpacing;
+}
+
+pair<uint32_t, uint32_t> TblMetrics::Extent(u16string_view Str, size_t& Missing) const noexcept {
+  auto W = 0u;
+  auto H = 0u;
+  auto Y = 0u;
+  for (;;) {
+    auto End = Str.find(u'\n');
+    auto Len = End == Str.npos ? Str.size() : End;
+    auto LnW = 0u;
+    auto LnH = 0u;
+    MeasureLine(Str.data(), Len, LnW, LnH, Missing);
+    W = max(W, LnW);
+    H = max(H, Y + max(LnH, LnSpacing));
+    if (End == Str.npos)
+      break;
+    Y += LnSpacing;
+    Str.remove_prefix(End + 1);
+  }
+  return {W, H};
+}
+
+void TblMetrics::MeasureLine(const char16_t* Str, size_t Len, uint32_t& W, uint32_t& H, size_t& Missing) const noexcept {
+  auto i = size_t{0};
+  auto NHas = size_t{0};
+#ifdef TBL_SSE2
+  // The lookups are scalar, the 16 advances are then summed by psadbw
+  alignas(16) uint8_t A[16], B[16], C[16];
+  auto Sum = _mm_setzero_si128();
+  auto Max = _mm_setzero_si128();
+  auto Cnt = _mm_setzero_si128();
+  for (; i + 16 <= Len; i += 16) {
+    for (auto j = 0; j < 16; ++j) {
+      auto Ch = (uint16_t) Str[i + j];
+      A[j] = Adv[Ch];
+      B[j] = Hgt[Ch];
+      C[j] = Has[Ch];
+    }
+    auto Zero = _mm_setzero_si128();
+    Sum = _mm_add_epi64(Sum, _mm_sad_epu8(_mm_load_si128((const __m128i*) A), Zero));
+    Cnt = _mm_add_epi64(Cnt, _mm_sad_epu8(_mm_load_si128((const __m128i*) C), Zero));
+    Max = _mm_max_epu8(Max, _mm_load_si128((const __m128i*) B));
+  }
+  alignas(16) uint8_t M[16];
+  _mm_store_si128((__m128i*) M, Max);
+  W = (uint32_t) (_mm_cvtsi128_si32(Sum) + _mm_cvtsi128_si32(_mm_srli_si128(Sum, 8)));
+  NHas = (size_t) (_mm_cvtsi128_si32(Cnt) + _mm_cvtsi128_si32(_mm_srli_si128(Cnt, 8)));
+  H = *max_element(M, M + 16);
+#endif
+  for (; i < Len; ++i) {
+    auto Ch = (uint16_t) Str[i];
+    W += Adv[Ch];
+    H = max(H, (uint32_t) Hgt[Ch]);
+    NHas += Has[Ch];
+  }
+  Missing += Len - NHas;
+}
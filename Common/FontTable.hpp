@@ -31,3 +31,20 @@ struct FontTable {
 };
 
 constexpr uint32_t TblSign = 0x216f6f57;
+
+// Text extents from TBL metrics alone, where the advance of a char is its
+// Width and lines are LnSpacing apart. No DC6 is needed.
+class TblMetrics {
+public:
+  void FromTbl(const FontTable& Tbl);
+
+  // Chars not in the TBL take no space and are counted in Missing
+  pair<uint32_t, uint32_t> Extent(u16string_view Str, size_t& Missing) const noexcept;
+private:
+  array<uint8_t, 0x10000> Adv{};
+  array<uint8_t, 0x10000> Hgt{};
+  array<uint8_t, 0x10000> Has{};
+  uint32_t LnSpacing{};
+
+  void MeasureLine(const char16_t* Str, size_t Len, uint32_t& W, uint32_t& H, size_t& Missing) const noexcept;
+};
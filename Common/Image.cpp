@@ -0,0 +1,189 @@
+#include "AutoFile.hpp"
+#include "Image.hpp"
+#include "Png.hpp"
+
+namespace {
+  // Pixel x of a row as RGBA
+  array<uint8_t, 4> GetRgba(const uint8_t* Row, size_t x, uint32_t Channels) {
+    auto P = Row + x * Channels;
+    if (Channels == 1)
+      return {P[0], P[0], P[0], 255};
+    return {P[0], P[1], P[2], Channels == 4 ? P[3] : (uint8_t) 255};
+  }
+
+  void SavePnm(const char* Path, const uint8_t* Data, ptrdiff_t Pitch, uint32_t W, uint32_t H,
+    uint32_t Channels, bool Gray) {
+    auto OutCh = Gray ? 1u : 3u;
+    auto Hdr = "P" + to_string(Gray ? 5 : 6) + "\n" + to_string(W) + " " + to_string(H) + "\n255\n";
+    auto File = AutoFile(Path, "wb");
+    File.Put(Hdr.data(), Hdr.size());
+    if (Channels == OutCh) {
+      for (auto y = 0u; y < H; ++y)
+        File.Put(Data + y * Pitch, (size_t) W * OutCh);
+      return;
+    }
+    vector<uint8_t> Row((size_t) W * OutCh);
+    for (auto y = 0u; y < H; ++y) {
+      auto Src = Data + y * Pitch;
+      for (auto x = size_t{0}; x < W; ++x) {
+        auto Px = GetRgba(Src, x, Channels);
+        if (Gray)
+          Row[x] = (uint8_t) ((Px[0] + Px[1] + Px[2]) / 3);
+        else
+          copy_n(Px.data(), 3, &Row[x * 3]);
+      }
+      File.Put(Row.data(), Row.size());
+    }
+  }
+
+  ImgFormat FormatOf(const char* Path, const ImgOptions& Opt) {
+    if (Opt.Format != ImgFormat::Auto)
+      return Opt.Format;
+    auto Dot = strrchr(Path, '.');
+    if (!Dot || strpbrk(Dot, "/\\"))
+      return ImgFormat::Png;
+    return ParseImgFormat(Dot + 1);
+  }
+
+  // The Quite OK Image format, see qoiformat.org
+  void SaveQoi(const char* Path, const uint8_t* Data, ptrdiff_t Pitch, uint32_t W, uint32_t H, uint32_t Channels) {
+    string Out;
+    Out.reserve((size_t) W * H * (Channels == 4 ? 5 : 4) / 2 + 22);
+    auto Put32 = [&](uint32_t V) {
+      for (auto s = 24; s >= 0; s -= 8)
+        Out += (char) (V >> s);
+    };
+    Out += "qoif";
+    Put32(W);
+    Put32(H);
+    Out += (char) (Channels == 4 ? 4 : 3);
+    Out += (char) 0; // sRGB with linear alpha
+    array<uint8_t, 4> Index[64]{};
+    array<uint8_t, 4> Prev{0, 0, 0, 255};
+    auto Run = 0u;
+    for (auto y = 0u; y < H; ++y) {
+      auto Row = Data + y * Pitch;
+      for (auto x = size_t{0}; x < W; ++x) {
+        auto Px = GetRgba(Row, x, Channels);
+        if (Px == Prev) {
+          if (++Run == 62) {
+            Out += (char) (0xc0 | (Run - 1));
+            Run = 0;
+          }
+          continue;
+        }
+        if (Run) {
+          Out += (char) (0xc0 | (Run - 1));
+          Run = 0;
+        }
+        auto Hash = (Px[0] * 3 + Px[1] * 5 + Px[2] * 7 + Px[3] * 11) % 64;
+        if (Index[Hash] == Px)
+          Out += (char) Hash;
+        else {
+          Index[Hash] = Px;
+          if (Px[3] == Prev[3]) {
+            auto Dr = (int8_t) (Px[0] - Prev[0]);
+            auto Dg = (int8_t) (Px[1] - Prev[1]);
+            auto Db = (int8_t) (Px[2] - Prev[2]);
+            auto Drg = Dr - Dg;
+            auto Dbg = Db - Dg;
+            if (Dr >= -2 && Dr <= 1 && Dg >= -2 && Dg <= 1 && Db >= -2 && Db <= 1)
+              Out += (char) (0x40 | (Dr + 2) << 4 | (Dg + 2) << 2 | (Db + 2));
+            else if (Dg >= -32 && Dg <= 31 && Drg >= -8 && Drg <= 7 && Dbg >= -8 && Dbg <= 7) {
+              Out += (char) (0x80 | (Dg + 32));
+              Out += (char) ((Drg + 8) << 4 | (Dbg + 8));
+            }
+            else {
+              Out += (char) 0xfe;
+              Out.append((const char*) Px.data(), 3);
+            }
+          }
+          else {
+            Out += (char) 0xff;
+            Out.append((const char*) Px.data(), 4);
+          }
+        }
+        Prev = Px;
+      }
+    }
+    if (Run)
+      Out += (char) (0xc0 | (Run - 1));
+    Out.append(7, '\0');
+    Out += '\1';
+    AutoFile(Path, "wb").Put(Out.data(), Out.size());
+  }
+}
+
+ImgFormat ParseImgFormat(string_view Name) {
+  string Low(Name);
+  for (auto& c : Low)
+    c = (char) tolower((unsigned char) c);
+  if (Low == "png")
+    return ImgFormat::Png;
+  if (Low == "ppm")
+    return ImgFormat::Ppm;
+  if (Low == "pgm")
+    return ImgFormat::Pgm;
+  if (Low == "qoi")
+    return ImgFormat::Qoi;
+  Abort("Unknown image format: %.*s", (int) Name.size(), Name.data());
+}
+
+void SaveImage(const char* Path, const uint8_t* Data, ptrdiff_t Pitch, uint32_t W, uint32_t H,
+  uint32_t Channels, const ImgOptions& Opt) {
+  if (Channels != 1 && Channels != 3 && Channels != 4)
+    Abort("Images should have 1, 3 or 4 channels instead of %u", Channels);
+  auto Fmt = FormatOf(Path, Opt);
+  switch (Fmt) {
+  case ImgFormat::Png: {
+    PngWriter Writer;
+    Writer.NThread = Opt.NThread;
+    Writer.Level = Opt.Level;
+    Writer.Filter = Opt.Filter;
+    Writer.Write(Path, Data, Pitch, W, H, Channels);
+    break;
+  }
+  case ImgFormat::Ppm:
+  case ImgFormat::Pgm:
+    SavePnm(Path, Data, Pitch, W, H, Channels, Fmt == ImgFormat::Pgm);
+    break;
+  case ImgFormat::Qoi:
+    SaveQoi(Path, Data, Pitch, W, H, Channels);
+    break;
+  default:
+    Abort("Invalid image format (%u)", (uint32_t) Fmt);
+  }
+}
+
+void SaveIndexed(const char* Path, BitmapView<const uint8_t> Idx, const uint8_t* Plte, int32_t Key,
+  const ImgOptions& Opt) {
+  auto W = (uint32_t) Idx.Width();
+  auto H = (uint32_t) Idx.Height();
+  if (FormatOf(Path, Opt) == ImgFormat::Png) {
+    PngWriter Writer;
+    Writer.NThread = Opt.NThread;
+    Writer.Level = Opt.Level;
+    Writer.Filter = Opt.Filter;
+    // Small frames would be mostly palette otherwise
+    auto Max = max(Key, 0);
+    for (auto y = 0u; y < H; ++y)
+      for (auto x = 0u; x < W; ++x)
+        Max = max<int32_t>(Max, Idx[y][x]);
+    Writer.Plte = Plte;
+    Writer.NColor = (uint32_t) Max + 1;
+    Writer.Key = Key;
+    Writer.Write(Path, Idx.Raw(), Idx.Stride(), W, H, 1);
+    return;
+  }
+  vector<uint8_t> Rgba((size_t) W * H * 4);
+  for (auto y = 0u; y < H; ++y)
+    for (auto x = 0u; x < W; ++x) {
+      auto c = Idx[y][x];
+      auto Out = &Rgba[((size_t) y * W + x) * 4];
+      if (c != Key) {
+        copy_n(Plte + c * 3, 3, Out);
+        Out[3] = 255;
+      }
+    }
+  SaveImage(Path, Rgba.data(), (ptrdiff_t) W * 4, W, H, 4, Opt);
+}
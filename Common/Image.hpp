@@ -0,0 +1,39 @@
+#pragma once
+
+#include "BitmapView.hpp"
+#include "Common.hpp"
+
+enum class ImgFormat : uint8_t {
+  Auto, // by the extension of the path, PNG without one
+  Png,
+  Ppm,  // raw (P6), alpha is dropped
+  Pgm,  // raw (P5), colors are averaged
+  Qoi,
+};
+
+struct ImgOptions {
+  ImgFormat Format{ImgFormat::Auto};
+  int32_t Level{6};   // PNG compression level (0-9)
+  int32_t Filter{-1}; // PNG row filter type (0-4), -1 to pick for each row
+  uint32_t NThread{}; // PNG threads, 0 for one per core
+};
+
+// "png", "ppm", "pgm" or "qoi", case insensitive
+ImgFormat ParseImgFormat(string_view Name);
+
+// Data: 8-bit rows of 1 (gray), 3 (RGB) or 4 (RGBA) channels
+void SaveImage(const char* Path, const uint8_t* Data, ptrdiff_t Pitch, uint32_t W, uint32_t H,
+  uint32_t Channels, const ImgOptions& Opt = {});
+
+// Palette indices. Plte: 256 RGB colors; Key: the transparent index, -1 for
+// none. PNG stays indexed, the other formats get the colors (with alpha in
+// QOI).
+void SaveIndexed(const char* Path, BitmapView<const uint8_t> Idx, const uint8_t* Plte, int32_t Key,
+  const ImgOptions& Opt = {});
+
+// Elements of 1, 3 or 4 bytes are saved as as many channels
+template<class Elem>
+void SaveImage(const char* Path, BitmapView<Elem> View, const ImgOptions& Opt = {}) {
+  SaveImage(Path, (const uint8_t*) View.Raw(), View.Stride() * (ptrdiff_t) sizeof(Elem),
+    (uint32_t) View.Width(), (uint32_t) View.Height(), sizeof(Elem), Opt);
+}
@@ -0,0 +1,144 @@
+#include "AutoFile.hpp"
+#include "MappedFile.hpp"
+
+#include <filesystem>
+#include <mutex>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(MappedFile&& Another) noexcept :
+  Ptr(exchange(Another.Ptr, nullptr)), Len(exchange(Another.Len, 0)), Owned(exchange(Another.Owned, false)) {}
+
+MappedFile::MappedFile(const char* Path) {
+  Open(Path);
+}
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+MappedFile& MappedFile::operator =(MappedFile&& Another) noexcept {
+  Another.Swap(*this);
+  Another.Close();
+  return *this;
+}
+
+void MappedFile::Swap(MappedFile& Another) noexcept {
+  swap(Ptr, Another.Ptr);
+  swap(Len, Another.Len);
+  swap(Owned, Another.Owned);
+}
+
+void MappedFile::Read(const char* Path) {
+  Close();
+  auto File = AutoFile(Path, "rb");
+  auto Size = File.Size();
+  if (!Size)
+    Abort("Failed to read %s: the file is empty", Path);
+  auto Buf = make_unique<uint8_t[]>(Size);
+  File.Get(Buf.get(), Size);
+  Ptr = Buf.release();
+  Len = Size;
+  Owned = true;
+}
+
+void MappedFile::Close() noexcept {
+  if (Owned) {
+    delete[] Ptr;
+    Ptr = nullptr;
+    Len = 0;
+    Owned = false;
+  }
+  else
+    Unmap();
+}
+
+#ifdef _WIN32
+void MappedFile::Open(const char* Path) {
+  Close();
+  auto File = CreateFileA(Path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (File == INVALID_HANDLE_VALUE)
+    Abort("Failed to open %s", Path);
+  LARGE_INTEGER Size;
+  if (!GetFileSizeEx(File, &Size) || !Size.QuadPart) {
+    CloseHandle(File);
+    Abort("Failed to map %s: the file is empty or its size is unknown", Path);
+  }
+  // The view keeps the mapping, and the mapping the file, alive
+  auto Mapping = CreateFileMappingA(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(File);
+  if (!Mapping)
+    Abort("Failed to map %s", Path);
+  auto View = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(Mapping);
+  if (!View)
+    Abort("Failed to map %s", Path);
+  Ptr = (const uint8_t*) View;
+  Len = (size_t) Size.QuadPart;
+}
+
+void MappedFile::Unmap() noexcept {
+  if (Ptr) {
+    UnmapViewOfFile(Ptr);
+    Ptr = nullptr;
+    Len = 0;
+  }
+}
+#else
+void MappedFile::Open(const char* Path) {
+  Close();
+  auto Fd = open(Path, O_RDONLY);
+  if (Fd < 0)
+    Abort("Failed to open %s", Path);
+  struct stat St;
+  if (fstat(Fd, &St) || !St.st_size) {
+    close(Fd);
+    Abort("Failed to map %s: the file is empty or its size is unknown", Path);
+  }
+  auto View = mmap(nullptr, (size_t) St.st_size, PROT_READ, MAP_SHARED, Fd, 0);
+  close(Fd);
+  if (View == MAP_FAILED)
+    Abort("Failed to map %s", Path);
+  Ptr = (const uint8_t*) View;
+  Len = (size_t) St.st_size;
+}
+
+void MappedFile::Unmap() noexcept {
+  if (Ptr) {
+    munmap((void*) Ptr, Len);
+    Ptr = nullptr;
+    Len = 0;
+  }
+}
+#endif
+
+shared_ptr<const MappedFile> MapShared(const string& Path, bool Copy) {
+  static mutex Mtx;
+  static unordered_map<string, pair<filesystem::file_time_type, weak_ptr<const MappedFile>>> Files;
+  error_code Ec;
+  auto Time = filesystem::last_write_time(Path, Ec);
+  lock_guard<mutex> Lock(Mtx);
+  auto& [SlotTime, Slot] = Files[Path];
+  auto File = Slot.lock();
+  if (!File || Ec || SlotTime != Time) {
+    auto New = make_shared<MappedFile>();
+    if (Copy)
+      New->Read(Path.c_str());
+    else
+      New->Open(Path.c_str());
+    File = move(New);
+    Slot = File;
+    SlotTime = Ec ? filesystem::file_time_type::min() : Time;
+  }
+  return File;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Common.hpp"
+
+// Read-only mapping of a whole file
+class MappedFile final {
+public:
+  constexpr MappedFile() noexcept = default;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile(MappedFile&& Another) noexcept;
+  MappedFile(const char* Path);
+  ~MappedFile();
+
+  MappedFile& operator =(const MappedFile&) = delete;
+  MappedFile& operator =(MappedFile&& Another) noexcept;
+
+  void Swap(MappedFile& Another) noexcept;
+
+  void Open(const char* Path);
+  // Copies the file into memory instead, so that it can be replaced while
+  // held, which Windows forbids for a mapped file
+  void Read(const char* Path);
+  void Close() noexcept;
+
+  constexpr const uint8_t* Data() const noexcept { return Ptr; }
+  constexpr size_t Size() const noexcept { return Len; }
+private:
+  const uint8_t* Ptr = nullptr;
+  size_t Len = 0;
+  bool Owned = false; // by Read
+
+  void Unmap() noexcept;
+};
+
+// Maps each file once for the whole process, so that the FreeType instances
+// of all threads read a face from the same pages. The file stays mapped
+// while any of its users holds it. A file rewritten since it was mapped is
+// mapped anew, and the users of the old mapping keep it. Copy: Read instead
+// of Open, if the file is not held already.
+shared_ptr<const MappedFile> MapShared(const string& Path, bool Copy = false);
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+// Blocks producers when full and consumers when empty
+template<class T>
+class BoundedQueue {
+public:
+  BoundedQueue(size_t Capacity_) noexcept : Capacity(max(Capacity_, size_t{1})) {}
+
+  // Items pushed after Close are dropped
+  void Push(T&& Item) {
+    unique_lock<mutex> Lock(Mtx);
+    NotFull.wait(Lock, [&] { return Items.size() < Capacity || Closed; });
+    if (Closed)
+      return;
+    Items.emplace_back(move(Item));
+    NotEmpty.notify_one();
+  }
+
+  // False once the queue is closed and drained
+  bool Pop(T& Item) {
+    unique_lock<mutex> Lock(Mtx);
+    NotEmpty.wait(Lock, [&] { return !Items.empty() || Closed; });
+    if (Items.empty())
+      return false;
+    Item = move(Items.front());
+    Items.pop_front();
+    NotFull.notify_one();
+    return true;
+  }
+
+  // No more items will be pushed, or a stage has failed and the blocked
+  // producers should give up
+  void Close() {
+    lock_guard<mutex> Lock(Mtx);
+    Closed = true;
+    NotEmpty.notify_all();
+    NotFull.notify_all();
+  }
+private:
+  size_t Capacity;
+  deque<T> Items;
+  bool Closed{};
+  mutex Mtx;
+  condition_variable NotFull;
+  condition_variable NotEmpty;
+};
+
+// First error of the threads of a job, rethrown on the thread that joins
+// them. Threads should stop early once it has failed.
+class ErrorSlot {
+public:
+  template<class Fn>
+  void Run(Fn&& Func) noexcept {
+    try {
+      Func();
+    }
+    catch (...) {
+      Set(current_exception());
+    }
+  }
+
+  void Set(exception_ptr Err_) noexcept {
+    lock_guard<mutex> Lock(Mtx);
+    if (!Err)
+      Err = Err_;
+    Flag = true;
+  }
+
+  bool Failed() const noexcept { return Flag; }
+
+  void Rethrow() {
+    if (Err)
+      rethrow_exception(Err);
+  }
+private:
+  mutex Mtx;
+  exception_ptr Err;
+  atomic<bool> Flag{false};
+};
+
+// Calls Fn(i) for i in [0, N) on NThread threads (0: one per core), the
+// order is unspecified. The first exception of Fn stops the loop, and is
+// rethrown once the threads are joined.
+template<class Fn>
+void ParallelFor(size_t N, uint32_t NThread, Fn&& Func) {
+  if (!NThread)
+    NThread = max(thread::hardware_concurrency(), 1u);
+  NThread = (uint32_t) min((size_t) NThread, N);
+  if (NThread <= 1) {
+    for (auto i = size_t{0}; i < N; ++i)
+      Func(i);
+    return;
+  }
+  atomic<size_t> Next{0};
+  ErrorSlot Errs;
+  vector<thread> Threads;
+  for (auto t = 0u; t < NThread; ++t)
+    Threads.emplace_back([&] {
+      Errs.Run([&] {
+        for (auto i = Next++; i < N && !Errs.Failed(); i = Next++)
+          Func(i);
+      });
+    });
+  for (auto& T : Threads)
+    T.join();
+  Errs.Rethrow();
+}
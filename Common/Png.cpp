@@ -0,0 +1,163 @@
+#include "AutoFile.hpp"
+#include "Pipeline.hpp"
+#include "Png.hpp"
+
+#include <zlib.h>
+
+namespace {
+  constexpr size_t WindowSize = 32768;
+
+  uint8_t Paeth(uint8_t A, uint8_t B, uint8_t C) {
+    auto P = (int32_t) A + B - C;
+    auto PA = abs(P - A);
+    auto PB = abs(P - B);
+    auto PC = abs(P - C);
+    if (PA <= PB && PA <= PC)
+      return A;
+    return PB <= PC ? B : C;
+  }
+
+  // Filters a row with the given type, or if Type is negative, the type that
+  // has the least sum of absolute values (the heuristic of libpng). Prev is
+  // null for the first row.
+  void FilterRow(uint8_t* Out, const uint8_t* Row, const uint8_t* Prev, size_t Size, uint32_t Bpp, int32_t Type, uint8_t* Tmp) {
+    auto Best = ~uint64_t{0};
+    auto Try = [&](uint8_t Cur, auto&& Pred) {
+      auto Sum = uint64_t{0};
+      for (auto i = size_t{0}; i < Size; ++i) {
+        Tmp[i] = (uint8_t) (Row[i] - Pred(i));
+        Sum += (uint64_t) abs((int8_t) Tmp[i]);
+      }
+      if (Sum < Best) {
+        Best = Sum;
+        Out[0] = Cur;
+        copy_n(Tmp, Size, Out + 1);
+      }
+    };
+    auto Left = [&](size_t i) { return i >= Bpp ? Row[i - Bpp] : 0; };
+    auto Up = [&](size_t i) { return Prev ? Prev[i] : 0; };
+    auto UpLeft = [&](size_t i) { return i >= Bpp && Prev ? Prev[i - Bpp] : 0; };
+    if (Type <= 0)
+      Try(0, [](size_t) { return 0; });
+    if (Type < 0 || Type == 1)
+      Try(1, Left);
+    if (Type < 0 ? Prev != nullptr : Type == 2)
+      Try(2, Up);
+    if (Type < 0 ? Prev != nullptr : Type == 3)
+      Try(3, [&](size_t i) { return (Left(i) + Up(i)) / 2; });
+    if (Type < 0 ? Prev != nullptr : Type == 4)
+      Try(4, [&](size_t i) { return Paeth(Left(i), Up(i), UpLeft(i)); });
+  }
+
+  void PutBe32(AutoFile& File, uint32_t Val) {
+    uint8_t Buf[4]{(uint8_t) (Val >> 24), (uint8_t) (Val >> 16), (uint8_t) (Val >> 8), (uint8_t) Val};
+    File.Put(Buf, 4);
+  }
+
+  // Data is given in pieces, the CRC covers the type and all the pieces
+  void PutChunk(AutoFile& File, const char* Type, initializer_list<string_view> Data) {
+    auto Len = size_t{0};
+    for (auto& D : Data)
+      Len += D.size();
+    PutBe32(File, Cast<uint32_t>(Len, "PNG chunk is too large (%zu bytes)", Len));
+    File.Put(Type, 4);
+    auto Crc = crc32(0, (const Bytef*) Type, 4);
+    for (auto& D : Data) {
+      File.Put(D.data(), D.size());
+      Crc = crc32_z(Crc, (const Bytef*) D.data(), D.size());
+    }
+    PutBe32(File, (uint32_t) Crc);
+  }
+}
+
+void PngWriter::Write(const char* Path, const uint8_t* Data, ptrdiff_t Pitch, uint32_t W, uint32_t H, uint32_t Channels) const {
+  if (Channels != 1 && Channels != 3 && Channels != 4)
+    Abort("PNG images should have 1, 3 or 4 channels instead of %u", Channels);
+  if (!W || !H)
+    Abort("Empty PNG image (%ux%u)", W, H);
+  if (Level < 0 || Level > 9)
+    Abort("Compression level (%d) should be in [0, 9]", Level);
+  if (Filter < -1 || Filter > 4)
+    Abort("Filter type (%d) should be in [0, 4] or -1", Filter);
+  if (Plte && Channels != 1)
+    Abort("Palette PNG images should have 1 channel instead of %u", Channels);
+  if (Plte && (NColor < 1 || NColor > 256))
+    Abort("Palette PNG images should have 1 to 256 colors instead of %u", NColor);
+  if (Key < -1 || Key > 255)
+    Abort("Transparent palette index (%d) should be in [0, 255] or -1", Key);
+  // Palette rows are not filtered by default, as the PNG spec suggests
+  auto Type = Plte && Filter < 0 ? 0 : Filter;
+  auto RowSize = (size_t) W * Channels;
+  auto Stride = RowSize + 1;
+  auto RowsPerStripe = max(StripeSize / Stride, size_t{1});
+  auto NStripe = (H + RowsPerStripe - 1) / RowsPerStripe;
+  // Rows only depend on the raw rows, so they are filtered in parallel first
+  vector<uint8_t> Filtered(Stride * H);
+  ParallelFor(NStripe, NThread, [&](size_t i) {
+    vector<uint8_t> Tmp(RowSize);
+    auto End = min((i + 1) * RowsPerStripe, (size_t) H);
+    for (auto y = i * RowsPerStripe; y < End; ++y)
+      FilterRow(Filtered.data() + y * Stride, Data + y * Pitch, y ? Data + (y - 1) * Pitch : nullptr,
+        RowSize, Channels, Type, Tmp.data());
+  });
+  // Each stripe is primed with the 32 KiB before it, so little is lost
+  vector<string> Deflated(NStripe);
+  vector<uLong> Adlers(NStripe);
+  ParallelFor(NStripe, NThread, [&](size_t i) {
+    auto Beg = i * RowsPerStripe * Stride;
+    auto End = min((i + 1) * RowsPerStripe, (size_t) H) * Stride;
+    z_stream Zs{};
+    if (deflateInit2(&Zs, Level, Z_DEFLATED, -15, 8, Z_FILTERED) != Z_OK)
+      Abort("Failed to initialize zlib");
+    if (Beg) {
+      auto Dict = min(Beg, WindowSize);
+      deflateSetDictionary(&Zs, Filtered.data() + Beg - Dict, (uInt) Dict);
+    }
+    auto& Out = Deflated[i];
+    Out.resize(deflateBound(&Zs, (uLong) (End - Beg)) + 16);
+    Zs.next_in = Filtered.data() + Beg;
+    Zs.avail_in = (uInt) (End - Beg);
+    Zs.next_out = (Bytef*) Out.data();
+    Zs.avail_out = (uInt) Out.size();
+    auto Flush = i + 1 == NStripe ? Z_FINISH : Z_SYNC_FLUSH;
+    auto Res = deflate(&Zs, Flush);
+    if (Res != (Flush == Z_FINISH ? Z_STREAM_END : Z_OK) || Zs.avail_in || !Zs.avail_out)
+      Abort("Failed to deflate PNG stripe %zu (%d)", i, Res);
+    Out.resize(Zs.total_out);
+    deflateEnd(&Zs);
+    Adlers[i] = adler32_z(1, Filtered.data() + Beg, End - Beg);
+  });
+  auto Adler = Adlers[0];
+  for (auto i = size_t{1}; i < NStripe; ++i) {
+    auto Len = (min((i + 1) * RowsPerStripe, (size_t) H) - i * RowsPerStripe) * Stride;
+    Adler = adler32_combine(Adler, Adlers[i], (z_off_t) Len);
+  }
+  auto File = AutoFile(Path, "wb");
+  File.Put("\x89PNG\r\n\x1a\n", 8);
+  uint8_t Ihdr[13]{
+    (uint8_t) (W >> 24), (uint8_t) (W >> 16), (uint8_t) (W >> 8), (uint8_t) W,
+    (uint8_t) (H >> 24), (uint8_t) (H >> 16), (uint8_t) (H >> 8), (uint8_t) H,
+    8, (uint8_t) (Plte ? 3 : Channels == 1 ? 0 : Channels == 3 ? 2 : 6), 0, 0, 0
+  };
+  PutChunk(File, "IHDR", {string_view((const char*) Ihdr, 13)});
+  if (Plte) {
+    PutChunk(File, "PLTE", {string_view((const char*) Plte, NColor * 3)});
+    if (Key >= 0) {
+      string Trns(Key + 1, (char) 255);
+      Trns[Key] = 0;
+      PutChunk(File, "tRNS", {Trns});
+    }
+  }
+  // zlib header, then one IDAT for each stripe, then the Adler-32
+  auto Flg = (uint8_t) ((Level < 2 ? 0 : Level < 6 ? 1 : Level == 6 ? 2 : 3) << 6);
+  Flg += 31 - (0x78 * 256 + Flg) % 31;
+  char ZHdr[2]{0x78, (char) Flg};
+  char ZEnd[4]{(char) (Adler >> 24), (char) (Adler >> 16), (char) (Adler >> 8), (char) Adler};
+  for (auto i = size_t{0}; i < NStripe; ++i)
+    PutChunk(File, "IDAT", {
+      string_view(ZHdr, i ? 0 : 2),
+      Deflated[i],
+      string_view(ZEnd, i + 1 == NStripe ? 4 : 0)
+    });
+  PutChunk(File, "IEND", {});
+}
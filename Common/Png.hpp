@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Common.hpp"
+
+// PNG writer for large images. Scanlines are filtered and deflated in
+// stripes on several threads; every stripe but the last ends with a sync
+// flush, so the stripes join into a single zlib stream (as pigz does).
+struct PngWriter {
+  uint32_t NThread{};         // 0: one per core
+  size_t StripeSize{1 << 20}; // filtered bytes per stripe, roughly
+  int32_t Level{6};           // zlib compression level
+  int32_t Filter{-1};         // row filter type (0-4), -1 to pick for each row
+  const uint8_t* Plte{};      // RGB colors, makes 1 channel palette indices
+  uint32_t NColor{256};       // colors of Plte written, all indices are below
+  int32_t Key{-1};            // palette index made transparent, -1 for none
+
+  // Channels: 1 (gray or indices), 3 (RGB) or 4 (RGBA), 8 bits each
+  void Write(const char* Path, const uint8_t* Data, ptrdiff_t Pitch, uint32_t W, uint32_t H, uint32_t Channels) const;
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "BitmapView.hpp"
 #include "Common.hpp"
 
 template<class Elem>
@@ -0,0 +1,241 @@
+#include "Config.hpp"
+#include "Coverage.hpp"
+#include "Diag.hpp"
+#include "Font.hpp"
+#include "MappedFile.hpp"
+#include "Service.hpp"
+
+#include <filesystem>
+
+namespace fs = ::std::filesystem;
+
+namespace {
+  // Changes whenever the file is rewritten
+  fs::file_time_type Stamp(const string& Path) {
+    error_code Ec;
+    auto Time = fs::last_write_time(Path, Ec);
+    return Ec ? fs::file_time_type::min() : Time;
+  }
+
+  // Each call starts with no diagnostics and no cache lookups, its failure
+  // is the Status
+  template<class Fn>
+  Status Guard(GlyphCache& Glyphs, Diagnostics& Diag, Fn&& Func) {
+    Diag.Clear();
+    Glyphs.ResetStats();
+    try {
+      Func();
+      return {};
+    }
+    catch (const bad_alloc&) {
+      return {"Out of memory"};
+    }
+    catch (const exception& E) {
+      return {E.what()};
+    }
+  }
+}
+
+struct FontService::Cache {
+  struct PalEntry {
+    fs::file_time_type Time;
+    Palette Pal;
+    unique_ptr<CovRamps> Ramps; // refers to Pal, so entries stay in place
+  };
+
+  struct FaceEntry {
+    fs::file_time_type Time;
+    shared_ptr<const MappedFile> File;
+  };
+
+  struct PreviewEntry {
+    vector<pair<string, fs::file_time_type>> Files; // the config, its faces and usage
+    unique_ptr<Font> Fnt;
+  };
+
+  unordered_map<string, unique_ptr<PalEntry>> Pals;
+  unordered_map<string, FaceEntry> Faces;
+  unordered_map<string, PreviewEntry> Previews;
+  unordered_map<string, pair<fs::file_time_type, unique_ptr<TblMetrics>>> Metrics;
+  GlyphCache Glyphs;
+  Diagnostics Diag; // of the last call, the fonts report to it
+  vector<pair<string, fs::file_time_type>> Inputs; // of the last Build
+
+  CovRamps& RampsOf(const string& Path) {
+    auto Time = Stamp(Path);
+    auto& E = Pals[Path];
+    if (!E || E->Time != Time) {
+      auto New = make_unique<PalEntry>();
+      New->Time = Time;
+      New->Pal.ReadDat(Path.c_str());
+      New->Ramps = make_unique<CovRamps>(New->Pal);
+      E = move(New);
+    }
+    return *E->Ramps;
+  }
+
+  // Reads the faces ahead of the FreeType sessions, which then share them.
+  // They are copied rather than mapped, so that an editor can replace them
+  // meanwhile. A face that changed is read anew, and the rasters of all
+  // faces are dropped, as they are not told apart by time, along with the
+  // preview fonts on that face.
+  void HoldFaces(const vector<string>& Paths) {
+    for (auto& Path : Paths) {
+      auto Time = Stamp(Path);
+      auto& E = Faces[Path];
+      if (E.File && E.Time == Time)
+        continue;
+      if (E.File) {
+        Glyphs.Clear();
+        for (auto It = Previews.begin(); It != Previews.end(); )
+          if (any_of(It->second.Files.begin(), It->second.Files.end(), [&](auto& F) { return F.first == Path; }))
+            It = Previews.erase(It);
+          else
+            ++It;
+      }
+      E.File.reset();
+      E.File = MapShared(Path, true);
+      E.Time = Time;
+    }
+  }
+
+  const TblMetrics& MetricsOf(const string& Path) {
+    auto Time = Stamp(Path);
+    auto& E = Metrics[Path];
+    if (!E.second || E.first != Time) {
+      FontTable Tbl;
+      Tbl.ReadTbl(Path.c_str());
+      auto Met = make_unique<TblMetrics>();
+      Met->FromTbl(Tbl);
+      E = {Time, move(Met)};
+    }
+    return *E.second;
+  }
+
+  static bool Fresh(const vector<pair<string, fs::file_time_type>>& Files) {
+    for (auto& [Path, Time] : Files)
+      if (Stamp(Path) != Time)
+        return false;
+    return true;
+  }
+};
+
+FontService::FontService() : Kept(make_unique<Cache>()) {
+  SetAbortThrows(true);
+}
+
+FontService::~FontService() = default;
+
+Status FontService::Build(const char* ConfigPath) {
+  return Guard(Kept->Glyphs, Kept->Diag, [&] {
+    // Stamped before reading, so that a change while building is seen
+    auto& Inputs = Kept->Inputs;
+    Inputs = {{ConfigPath, Stamp(ConfigPath)}};
+    vector<FontConfig> Cfgs;
+    vector<unique_ptr<Font>> Fnts;
+    if (!ReadFamily(ConfigPath, Cfgs, Fnts))
+      Abort("%s is not a D2MFC config", ConfigPath);
+    for (auto& Cfg : Cfgs) {
+      if (Cfg.PalPath != Cfgs[0].PalPath)
+        Abort("The sizes of a family should share one palette");
+      if (Cfg.LogPath != Cfgs[0].LogPath)
+        Abort("The sizes of a family should share one log");
+    }
+    Inputs.emplace_back(Cfgs[0].PalPath, Stamp(Cfgs[0].PalPath));
+    // Known once scanned, so a string table edited meanwhile is missed
+    for (auto& Path : Cfgs[0].UsagePaths)
+      Inputs.emplace_back(Path, Stamp(Path));
+    for (auto& Fnt : Fnts) {
+      for (auto& Face : Fnt->Faces)
+        Inputs.emplace_back(Face, Stamp(Face));
+      Kept->HoldFaces(Fnt->Faces);
+      Fnt->Cache = &Kept->Glyphs;
+    }
+    for (auto i = size_t{0}; i < Fnts.size(); ++i)
+      Fnts[i]->Diag = Fnts.size() > 1 ? &Kept->Diag.Part(Cfgs[i].Dc6Path) : &Kept->Diag;
+    auto& Ramps = Kept->RampsOf(Cfgs[0].PalPath);
+    vector<FontTable> Tbls(Cfgs.size());
+    vector<FontBuild> Builds;
+    for (auto i = size_t{0}; i < Cfgs.size(); ++i)
+      Builds.push_back({Fnts[i].get(), Cfgs[i].Dc6Path.c_str(), &Tbls[i], Cfgs[i].Dc6OffsetY});
+    Font::BuildFamily(Builds, Ramps, Cfgs[0].NThread);
+    for (auto i = size_t{0}; i < Cfgs.size(); ++i)
+      Tbls[i].SaveTbl(Cfgs[i].TblPath.c_str());
+    if (!Cfgs[0].LogPath.empty())
+      Kept->Diag.SaveLog(Cfgs[0].LogPath.c_str());
+  });
+}
+
+Status FontService::Preview(const char* ConfigPath, wstring_view Text, const char* ImgPath) {
+  return Guard(Kept->Glyphs, Kept->Diag, [&] {
+    auto& Previews = Kept->Previews;
+    try {
+      auto It = Previews.find(ConfigPath);
+      if (It == Previews.end() || !Cache::Fresh(It->second.Files)) {
+        Previews.erase(ConfigPath);
+        Cache::PreviewEntry E;
+        E.Files.emplace_back(ConfigPath, Stamp(ConfigPath));
+        auto Fnt = make_unique<Font>();
+        FontConfig Cfg;
+        if (!Cfg.Read(ConfigPath, *Fnt))
+          Abort("%s is not a D2MFC config", ConfigPath);
+        for (auto& Path : Cfg.UsagePaths)
+          E.Files.emplace_back(Path, Stamp(Path));
+        // May drop other previews, so the entry is added after
+        Kept->HoldFaces(Fnt->Faces);
+        for (auto& Face : Fnt->Faces)
+          E.Files.emplace_back(Face, Kept->Faces[Face].Time);
+        Fnt->Cache = &Kept->Glyphs;
+        Fnt->Diag = &Kept->Diag;
+        Fnt->DeferGlyphs();
+        E.Fnt = move(Fnt);
+        It = Previews.emplace(ConfigPath, move(E)).first;
+      }
+      It->second.Fnt->Render(Text).Save(ImgPath);
+    }
+    catch (...) {
+      // The font may be left half rendered
+      Kept->Previews.erase(ConfigPath);
+      throw;
+    }
+  });
+}
+
+Status FontService::Measure(const char* TblPath, u16string_view Text, uint32_t& W, uint32_t& H, size_t& Missing) {
+  return Guard(Kept->Glyphs, Kept->Diag, [&] {
+    Missing = 0;
+    tie(W, H) = Kept->MetricsOf(TblPath).Extent(Text, Missing);
+  });
+}
+
+Status FontService::ReadDc6(const char* Path, IdxSprite& Spr) {
+  return Guard(Kept->Glyphs, Kept->Diag, [&] { Spr.ReadDc6(Path); });
+}
+
+Status FontService::SaveDc6(const char* Path, IdxSprite& Spr, int32_t Dc6OffsetY) {
+  return Guard(Kept->Glyphs, Kept->Diag, [&] { Spr.SaveDc6(Path, Dc6OffsetY); });
+}
+
+Status FontService::ReadTbl(const char* Path, FontTable& Tbl) {
+  return Guard(Kept->Glyphs, Kept->Diag, [&] { Tbl.ReadTbl(Path); });
+}
+
+Status FontService::SaveTbl(const char* Path, FontTable& Tbl) {
+  return Guard(Kept->Glyphs, Kept->Diag, [&] { Tbl.SaveTbl(Path); });
+}
+
+bool FontService::InputsChanged() const {
+  return !Cache::Fresh(Kept->Inputs);
+}
+
+const GlyphCache& FontService::Glyphs() const noexcept {
+  return Kept->Glyphs;
+}
+
+const Diagnostics& FontService::Diags() const noexcept {
+  return Kept->Diag;
+}
+
+void FontService::Clear() {
+  Kept = make_unique<Cache>();
+}
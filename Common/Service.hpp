@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Common.hpp"
+#include "Diag.hpp"
+#include "Font.hpp"
+#include "FontTable.hpp"
+#include "Sprite.hpp"
+
+// Outcome of a FontService call, Error is empty on success
+struct Status {
+  string Error;
+
+  bool Ok() const noexcept { return Error.empty(); }
+};
+
+// Entry points for a host that builds and previews many fonts in one
+// process. Errors come back as a Status instead of ending the process, so
+// Abort is set to throw once a service exists. Palettes, the faces of built
+// configs, glyph rasters and preview fonts stay loaded across calls, until
+// their files change. Calls on one service must not overlap, but services on
+// different threads may run at once: each has its own diagnostics.
+class FontService {
+public:
+  FontService();
+  ~FontService();
+
+  // The DC6 and TBL of every size of a D2MFC config, as D2MFC makes them
+  Status Build(const char* ConfigPath);
+  // Renders Text with the face of a config, as Preview does. Glyphs are
+  // rasterized on first use and kept for later previews of the config.
+  Status Preview(const char* ConfigPath, wstring_view Text, const char* ImgPath);
+
+  // Extent of Text from the metrics of a TBL, as FitCheck measures it. Chars
+  // not in the TBL are counted in Missing.
+  Status Measure(const char* TblPath, u16string_view Text, uint32_t& W, uint32_t& H, size_t& Missing);
+
+  Status ReadDc6(const char* Path, IdxSprite& Spr);
+  Status SaveDc6(const char* Path, IdxSprite& Spr, int32_t Dc6OffsetY = 0);
+  Status ReadTbl(const char* Path, FontTable& Tbl);
+  Status SaveTbl(const char* Path, FontTable& Tbl);
+
+  // Whether a file read by the last Build (its config, palette or faces) has
+  // changed since, for a watcher to poll
+  bool InputsChanged() const;
+  // Rasters kept across builds, with the lookups of the last call
+  const GlyphCache& Glyphs() const noexcept;
+  // Warnings of the last call, instead of the process-wide Diags()
+  const Diagnostics& Diags() const noexcept;
+
+  // Drops what is kept loaded
+  void Clear();
+private:
+  struct Cache;
+  unique_ptr<Cache> Kept;
+};
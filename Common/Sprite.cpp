@@ -2,64 +2,67 @@
 #include "Sprite.hpp"
 
 namespace {
-  constexpr uint32_t Dc6HdrVer = 0x00000006;
   constexpr uint32_t Dc6HdrUnk1 = 0x00000001;
 
-#ifdef BMP_ALPHA
-  void ReadDc6Frame(AutoFile& File, Bitmap& Bmp, const Dc6FrameHeader& Frm, const Palette& Pal) {
-#else
-  void ReadDc6Frame(AutoFile& File, Bitmap& Bmp, const Dc6FrameHeader& Frm, const Palette& Pal, uint32_t Mask) {
-#endif
-    Bmp.Resize(Frm.Width, Frm.Height);
-#ifdef BMP_ALPHA
-    Bmp.Fill({});
-#else
-    Bmp.Fill(Mask);
-#endif
+  array<uint8_t, 256> CovFromPal(const Palette& Pal) {
+    array<uint8_t, 256> Lum;
+    for (auto i = 0u; i < 256; ++i)
+      Lum[i] = (uint8_t) max(1u, ((uint32_t) Pal[i].R + Pal[i].G + Pal[i].B) / 3);
+    return Lum;
+  }
+
+  Dc6Header ReadDc6Header(AutoFile& File, RcArray<uint32_t>& Offs) {
+    auto Hdr = File.Get<Dc6Header>();
+    if (Hdr.Version != Dc6HdrVer)
+      Abort("DC6 file should start with %.8x instead of %.8x", Dc6HdrVer, Hdr.Version);
+    Offs.Resize(Hdr.NDir, Hdr.NFrm);
+    File.Get(Offs.Raw(), Offs.Count());
+    return Hdr;
+  }
+
+  // The RLE bytes of a frame are read in one go, then decoded
+  template<class Img, class PutPix>
+  void ReadDc6Frame(AutoFile& File, Img& Bmp, const Dc6FrameHeader& Frm, PutPix&& Put) {
+    string Rle(Frm.Length, '\0');
+    File.Get(Rle.data(), Rle.size());
+    auto Src = (const uint8_t*) Rle.data();
     auto y = Bmp.Height() - 1;
     auto x = size_t{0};
     for (auto i = 0u; i < Frm.Length; ++i) {
-      auto b = File.Get<uint8_t>();
+      auto b = Src[i];
       if (b == 0x80) {
         x = 0;
         --y;
       }
       else if (b & 0x80)
         x += b & 0x7f;
-      else {
-        for (auto j = 0u; j < b; ++j, ++i) {
-          auto c = File.Get<uint8_t>();
-          if (c > 255)
-            Abort("Invalid color index: %u", c);
-          if (y >= Bmp.Height() || x >= Bmp.Width())
-            Abort("Invalid position (%zu,%zu)", x, y);
-          Bmp[y][x++] = Pal[c];
-        }
+      else if (b) {
+        if (b > Frm.Length - i - 1)
+          Abort("Frame data ends in a run of %u colors", b);
+        if (y >= Bmp.Height() || x + b > Bmp.Width())
+          Abort("Invalid position (%zu,%zu)", x + b - 1, y);
+        auto Row = Bmp[y] + x;
+        for (auto j = 0u; j < b; ++j)
+          Put(Row[j], Src[i + 1 + j]);
+        x += b;
+        i += b;
       }
     }
   }
 
-#ifdef BMP_ALPHA
-  void WriteDc6Frame(AutoFile& File, const Bitmap& Bmp, PalEncoder& Enc) {
-#else
-  void WriteDc6Frame(AutoFile& File, const Bitmap& Bmp, PalEncoder& Enc, uint32_t Mask) {
-#endif
+  // Appends the RLE bytes of a frame, terminator included
+  template<class Img, class IsOpq, class Enc>
+  void WriteDc6Frame(string& Out, const Img& Bmp, IsOpq&& Opq, Enc&& Encode) {
     if (Bmp.Count()) {
-      auto Done = false;
       auto y = Bmp.Height() - 1;
       auto x = size_t{0};
       auto n = 0u;
       for (;;) {
-#ifdef BMP_ALPHA
-        while (x + n < Bmp.Width() && !Bmp[y][x + n].A)
+        while (x + n < Bmp.Width() && !Opq(Bmp[y][x + n]))
           ++n;
-#else
-        while (x + n < Bmp.Width() && Bmp[y][x + n].Rgb() == Mask)
-          ++n;
-#endif
         if (x + n == Bmp.Width()) {
           // End of Line
-          File.Put<uint8_t>(0x80);
+          Out += (char) 0x80;
           x = 0;
           n = 0;
           if (!y--)
@@ -69,107 +72,279 @@ namespace {
         if (n) {
           // Transparent
           while (n > 0x7f) {
-            File.Put<uint8_t>(0xff);
+            Out += (char) 0xff;
             x += 0x7f;
             n -= 0x7f;
           }
-          File.Put<uint8_t>(n | 0x80);
+          Out += (char) (n | 0x80);
           x += n;
           n = 0;
         }
-#ifdef BMP_ALPHA
-        while (x + n < Bmp.Width() && Bmp[y][x + n].A)
-          ++n;
-#else
-        while (x + n < Bmp.Width() && Bmp[y][x + n].Rgb() != Mask)
+        while (x + n < Bmp.Width() && Opq(Bmp[y][x + n]))
           ++n;
-#endif
-        if (n) {
+        while (n) {
           // Colors
-          while (n > 0x7f) {
-            File.Put<uint8_t>(0x7f);
-            for (auto i = 0u; i < 0x7f; ++i)
-              File.Put<uint8_t>(Enc.Encode(Bmp[y][x + i]));
-            x += 0x7f;
-            n -= 0x7f;
-          }
-          File.Put<uint8_t>(n);
-          for (auto i = 0u; i < n; ++i)
-            File.Put<uint8_t>(Enc.Encode(Bmp[y][x + i]));
-          x += n;
-          n = 0;
+          auto m = min(n, 0x7fu);
+          Out += (char) m;
+          for (auto i = 0u; i < m; ++i)
+            Out += (char) Encode(Bmp[y][x + i]);
+          x += m;
+          n -= m;
         }
       }
     }
-    uint8_t Term[3]{0xee, 0xee, 0xee};
-    File.Put(Term, 3);
+    Out.append(3, (char) 0xee);
   }
+
+  template<class Spr, class ReadFrm>
+  void ReadDc6Frames(const char* Path, Spr& S, ReadFrm&& Read) {
+    auto File = AutoFile(Path, "rb");
+    RcArray<uint32_t> Offs;
+    auto Hdr = ReadDc6Header(File, Offs);
+    S.Resize(Hdr.NDir, Hdr.NFrm);
+    for (uint32_t IDir = 0; IDir < Hdr.NDir; ++IDir)
+      for (uint32_t IFrm = 0; IFrm < Hdr.NFrm; ++IFrm) {
+        auto Frm = File.GetAt<Dc6FrameHeader>(Offs[IDir][IFrm]);
+        Read(File, S[IDir][IFrm], Frm);
+      }
+  }
+
+  template<class Spr, class WriteFrm>
+  void SaveDc6Frames(const char* Path, Spr& S, int32_t Dc6OffsetY, WriteFrm&& Write) {
+    Dc6Writer W;
+    W.Open(Path, S.NDir(), S.NFrm());
+    string Rle;
+    for (auto IDir = 0u; IDir < S.NDir(); ++IDir)
+      for (auto IFrm = 0u; IFrm < S.NFrm(); ++IFrm) {
+        auto& Bmp = S[IDir][IFrm];
+        Rle.clear();
+        Write(Rle, Bmp, IDir, IFrm);
+        W.Put((uint32_t) Bmp.Width(), (uint32_t) Bmp.Height(), Dc6OffsetY, Rle);
+      }
+    W.Close();
+  }
+}
+
+template<class Pix>
+void BasicSprite<Pix>::ReadDc6(const char* Path, const Palette& Pal, uint32_t Mask) {
+  ReadDc6Frames(Path, *this,
+    [&](AutoFile& File, BasicBitmap<Pix>& Bmp, const Dc6FrameHeader& Frm) {
+      Bmp.Resize(Frm.Width, Frm.Height);
+      if constexpr (BasicBitmap<Pix>::HasAlpha)
+        Bmp.Fill({0, 0, 0, 0});
+      else
+        Bmp.Fill(Mask);
+      ReadDc6Frame(File, Bmp, Frm, [&](Pix& Px, uint8_t c) { Px = Pal[c]; });
+    }
+  );
+}
+
+template<class Pix>
+void BasicSprite<Pix>::SaveDc6(const char* Path, const Palette& Pal, int32_t Dc6OffsetY, uint32_t Mask) {
+  PalEncoder Enc(Pal);
+  SaveDc6Frames(Path, *this, Dc6OffsetY,
+    [&](string& Rle, const BasicBitmap<Pix>& Bmp, size_t, size_t) {
+      if constexpr (BasicBitmap<Pix>::HasAlpha)
+        WriteDc6Frame(Rle, Bmp, [](const PixelA& Px) { return Px.A != 0; },
+          [&](const PixelA& Px) { return Enc.Encode(Px.Color()); });
+      else
+        WriteDc6Frame(Rle, Bmp, [&](const Pixel& Px) { return Px.Rgb() != Mask; },
+          [&](const Pixel& Px) { return Enc.Encode(Px); });
+    }
+  );
+}
+
+template class BasicSprite<Pixel>;
+template class BasicSprite<PixelA>;
+
+void CovSprite::ReadDc6(const char* Path, const Palette& Pal) {
+  auto Lum = CovFromPal(Pal);
+  ReadDc6Frames(Path, *this,
+    [&](AutoFile& File, Coverage& Cov, const Dc6FrameHeader& Frm) {
+      Cov.Resize(Frm.Width, Frm.Height);
+      Cov.Fill(0);
+      ReadDc6Frame(File, Cov, Frm, [&](uint8_t& Pix, uint8_t c) { Pix = Lum[c]; });
+    }
+  );
+}
+
+void CovSprite::SaveDc6(const char* Path, const CovLut& Lut, int32_t Dc6OffsetY) {
+  SaveDc6Frames(Path, *this, Dc6OffsetY,
+    [&](string& Rle, const Coverage& Cov, size_t, size_t) {
+      EncodeDc6(Rle, Cov, Lut);
+    }
+  );
+}
+
+void CovSprite::SaveDc6(const char* Path, const CovRamps& Ramps, int32_t Dc6OffsetY) {
+  if (Ramp.NRow() != NDir() || Ramp.NCol() != NFrm())
+    Abort("The ramp table (%zux%zu) does not match the sprite (%zux%zu)", Ramp.NRow(), Ramp.NCol(), NDir(), NFrm());
+  SaveDc6Frames(Path, *this, Dc6OffsetY,
+    [&](string& Rle, const Coverage& Cov, size_t IDir, size_t IFrm) {
+      EncodeDc6(Rle, Cov, Ramps[Ramp[IDir][IFrm]]);
+    }
+  );
 }
 
-#ifdef BMP_ALPHA
-void Sprite::ReadDc6(const char* Path, const Palette& Pal) {
-#else
-void Sprite::ReadDc6(const char* Path, const Palette& Pal, uint32_t Mask) {
-#endif
+void IdxSprite::ReadDc6(const char* Path) {
+  ReadDc6Frames(Path, *this,
+    [&](AutoFile& File, IdxBitmap& Bmp, const Dc6FrameHeader& Frm) {
+      Bmp.Resize(Frm.Width, Frm.Height);
+      Bmp.Fill({0, 0});
+      ReadDc6Frame(File, Bmp, Frm, [](PixelI& Pix, uint8_t c) { Pix = {c, 1}; });
+    }
+  );
+}
+
+IdxBitmap IdxSprite::ReadFrame(const char* Path, uint32_t Offset) {
   auto File = AutoFile(Path, "rb");
-  auto Hdr = File.Get<Dc6Header>();
-  if (Hdr.Version != Dc6HdrVer)
-    Abort("DC6 file should start with %.8x instead of %.8x", Dc6HdrVer, Hdr.Version);
-  Resize(Hdr.NDir, Hdr.NFrm);
-  auto Offs = RcArray<uint32_t>(Hdr.NDir, Hdr.NFrm);
-  File.Get(Offs.Raw(), Offs.Count());
-  for (uint32_t IDir = 0; IDir < Hdr.NDir; ++IDir)
-    for (uint32_t IFrm = 0; IFrm < Hdr.NFrm; ++IFrm) {
-      auto Frm = File.GetAt<Dc6FrameHeader>(Offs[IDir][IFrm]);
-#ifdef BMP_ALPHA
-      ReadDc6Frame(File, (*this)[IDir][IFrm], Frm, Pal);
-#else
-      ReadDc6Frame(File, (*this)[IDir][IFrm], Frm, Pal, Mask);
-#endif
+  if (File.Get<Dc6Header>().Version != Dc6HdrVer)
+    Abort("%s is not a DC6 file", Path);
+  auto Frm = File.GetAt<Dc6FrameHeader>(Offset);
+  IdxBitmap Bmp(Frm.Width, Frm.Height);
+  Bmp.Fill({0, 0});
+  ReadDc6Frame(File, Bmp, Frm, [](PixelI& Pix, uint8_t c) { Pix = {c, 1}; });
+  return Bmp;
+}
+
+void IdxSprite::SaveDc6(const char* Path, int32_t Dc6OffsetY) {
+  SaveDc6Frames(Path, *this, Dc6OffsetY,
+    [&](string& Rle, const IdxBitmap& Bmp, size_t, size_t) {
+      WriteDc6Frame(Rle, Bmp, [](const PixelI& Pix) { return Pix.Opq != 0; },
+        [](const PixelI& Pix) { return Pix.Idx; });
     }
+  );
 }
 
-#ifdef BMP_ALPHA
-void Sprite::SaveDc6(const char* Path, const Palette& Pal) {
-#else
-void Sprite::SaveDc6(const char* Path, const Palette& Pal, int32_t Dc6OffsetY, uint32_t Mask) {
-#endif
+void Dc6Writer::Open(const char* Path, size_t NDir, size_t NFrm) {
   Dc6Header Hdr;
   Hdr.Version = Dc6HdrVer;
   Hdr.Unk1 = Dc6HdrUnk1;
   Hdr.UnkZ = 0;
   Hdr.Term = 0xeeeeeeee;
-  Hdr.NDir = Cast<uint32_t>(NDir(), "Too many directions (%zu)", NDir());
-  Hdr.NFrm = Cast<uint32_t>(NFrm(), "Too many frames (%zu)", NFrm());
-  RcArray<uint32_t> Offs(NDir(), NFrm());
-  auto File = AutoFile(Path, "wb");
+  Hdr.NDir = Cast<uint32_t>(NDir, "Too many directions (%zu)", NDir);
+  Hdr.NFrm = Cast<uint32_t>(NFrm, "Too many frames (%zu)", NFrm);
+  Offs.Resize(NDir, NFrm);
+  Next = 0;
+  File.Open(Path, "wb");
   File.Put(Hdr);
-  auto FpOffs = File.Tell();
+  FpOffs = File.Tell();
   File.Advance(sizeof(uint32_t) * Offs.Count());
-  PalEncoder Enc(Pal);
-  for (auto IDir = 0u; IDir < NDir(); ++IDir)
-    for (auto IFrm = 0u; IFrm < NFrm(); ++IFrm) {
-      auto& Bmp = (*this)[IDir][IFrm];
-      Dc6FrameHeader Frm;
-      Frm.Flip = 0;
-      Frm.Width = (uint32_t) Bmp.Width();
-      Frm.Height = (uint32_t) Bmp.Height();
-      Frm.OffsetX = 0;
-      Frm.OffsetY = Dc6OffsetY;
-      Frm.Unk = 0;
-      Offs[IDir][IFrm] = Cast<uint32_t>(File.Tell(), "The resulted DC6 file is too large (%zu bytes)", File.Size());
-      File.Advance(sizeof(Dc6FrameHeader));
-      auto FpBeg = File.Tell();
-#ifdef BMP_ALPHA
-      WriteDc6Frame(File, Bmp, Enc);
-#else
-      WriteDc6Frame(File, Bmp, Enc, Mask);
-#endif
-      auto FpEnd = File.Tell();
-      Frm.NextBlock = (uint32_t) FpEnd;
-      Frm.Length = (uint32_t) (FpEnd - FpBeg - 3);
-      File.PutAt(Frm, Offs[IDir][IFrm]);
-      File.Seek(FpEnd);
-    }
+  Fp = File.Tell();
+}
+
+void Dc6Writer::Put(uint32_t Width, uint32_t Height, int32_t OffsetY, string_view Rle) {
+  if (Next == Offs.Count())
+    Abort("Too many frames are written, the DC6 file has only %zu", Offs.Count());
+  if (Rle.size() < 3)
+    Abort("The RLE bytes of frame %zu should end with a terminator", Next);
+  Dc6FrameHeader Frm;
+  Frm.Flip = 0;
+  Frm.Width = Width;
+  Frm.Height = Height;
+  Frm.OffsetX = 0;
+  Frm.OffsetY = OffsetY;
+  Frm.Unk = 0;
+  Offs.Raw()[Next++] = Cast<uint32_t>(Fp, "The resulted DC6 file is too large (%zu bytes)", Fp);
+  Fp += sizeof(Dc6FrameHeader) + Rle.size();
+  Frm.NextBlock = Cast<uint32_t>(Fp, "The resulted DC6 file is too large (%zu bytes)", Fp);
+  Frm.Length = (uint32_t) (Rle.size() - 3);
+  File.Put(Frm);
+  File.Put(Rle.data(), Rle.size());
+}
+
+void Dc6Writer::Close() {
+  if (Next != Offs.Count())
+    Abort("Only %zu of %zu frames are written", Next, Offs.Count());
   File.PutAt(Offs.Raw(), FpOffs, Offs.Count());
+  File.Close();
+}
+
+void EncodeDc6(string& Out, BitmapView<const uint8_t> Cov, const CovLut& Lut) {
+  WriteDc6Frame(Out, Cov, [](uint8_t Pix) { return Pix != 0; }, [&](uint8_t Pix) { return Lut[Pix]; });
+}
+
+void LazySprite::Open(const char* Path, const Palette& Pal, size_t Capacity_) {
+  // Frames of the sprite open before are not kept, even if this one fails
+  Lru.clear();
+  Map.clear();
+  File.Open(Path, "rb");
+  ReadDc6Header(File, Offs);
+  Lum = CovFromPal(Pal);
+  Capacity = max(Capacity_, size_t{1});
+}
+
+Dc6FrameHeader LazySprite::FrameHeader(size_t IDir, size_t IFrm) {
+  if (IDir >= NDir() || IFrm >= NFrm())
+    Abort("Frame (%zu,%zu) is out of range (%zux%zu)", IDir, IFrm, NDir(), NFrm());
+  return File.GetAt<Dc6FrameHeader>(Offs[IDir][IFrm]);
+}
+
+const Coverage& LazySprite::Frame(size_t IDir, size_t IFrm) {
+  auto Key = IDir * NFrm() + IFrm;
+  auto Res = Map.find(Key);
+  if (Res != Map.end()) {
+    Lru.splice(Lru.begin(), Lru, Res->second);
+    return Res->second->second;
+  }
+  auto Frm = FrameHeader(IDir, IFrm);
+  if (Lru.size() >= Capacity) {
+    // Reuse the storage of the least recently used frame
+    Map.erase(Lru.back().first);
+    Lru.splice(Lru.begin(), Lru, prev(Lru.end()));
+    Lru.front().first = Key;
+  }
+  else
+    Lru.emplace_front(Key, Coverage{});
+  Map.emplace(Key, Lru.begin());
+  auto& Cov = Lru.front().second;
+  Cov.Resize(Frm.Width, Frm.Height);
+  Cov.Fill(0);
+  ReadDc6Frame(File, Cov, Frm, [&](uint8_t& Pix, uint8_t c) { Pix = Lum[c]; });
+  return Cov;
+}
+
+IdxBitmap LazySprite::IdxFrame(size_t IDir, size_t IFrm) {
+  auto Frm = FrameHeader(IDir, IFrm);
+  IdxBitmap Bmp(Frm.Width, Frm.Height);
+  Bmp.Fill({0, 0});
+  ReadDc6Frame(File, Bmp, Frm, [](PixelI& Pix, uint8_t c) { Pix = {c, 1}; });
+  return Bmp;
+}
+
+void Dc6View::Parse(string_view Data_) {
+  Data = Data_;
+  if (Data.size() < sizeof(Dc6Header))
+    Abort("DC6 file is too small (%zu bytes)", Data.size());
+  memcpy(&Hdr, Data.data(), sizeof(Dc6Header));
+  if (Hdr.Version != Dc6HdrVer)
+    Abort("DC6 file should start with %.8x instead of %.8x", Dc6HdrVer, Hdr.Version);
+  auto NOff = (uint64_t) Hdr.NDir * Hdr.NFrm;
+  if (sizeof(Dc6Header) + NOff * sizeof(uint32_t) > Data.size())
+    Abort("DC6 offset table (%" PRIu64 " entries) exceeds the file size (%zu bytes)", NOff, Data.size());
+  for (auto IDir = 0u; IDir < Hdr.NDir; ++IDir)
+    for (auto IFrm = 0u; IFrm < Hdr.NFrm; ++IFrm) {
+      auto Off = (uint64_t) Offset(IDir, IFrm);
+      if (Off + sizeof(Dc6FrameHeader) > Data.size())
+        Abort("Frame (%u,%u) at %" PRIu64 " exceeds the file size (%zu bytes)", IDir, IFrm, Off, Data.size());
+      auto Frm = FrameHeader(IDir, IFrm);
+      if (Off + sizeof(Dc6FrameHeader) + Frm.Length > Data.size())
+        Abort("Frame (%u,%u) of %u bytes exceeds the file size (%zu bytes)", IDir, IFrm, Frm.Length, Data.size());
+    }
+}
+
+uint32_t Dc6View::Offset(size_t IDir, size_t IFrm) const {
+  uint32_t Off;
+  memcpy(&Off, Data.data() + sizeof(Dc6Header) + sizeof(uint32_t) * (IDir * NFrm() + IFrm), sizeof(uint32_t));
+  return Off;
+}
+
+Dc6FrameHeader Dc6View::FrameHeader(size_t IDir, size_t IFrm) const {
+  Dc6FrameHeader Frm;
+  memcpy(&Frm, Data.data() + Offset(IDir, IFrm), sizeof(Dc6FrameHeader));
+  return Frm;
+}
+
+string_view Dc6View::FrameRle(size_t IDir, size_t IFrm) const {
+  return Data.substr(Offset(IDir, IFrm) + sizeof(Dc6FrameHeader), FrameHeader(IDir, IFrm).Length);
 }
@@ -1,7 +1,9 @@
 #pragma once
 
+#include "AutoFile.hpp"
 #include "Bitmap.hpp"
 #include "Common.hpp"
+#include "Coverage.hpp"
 
 struct Dc6Header {
   uint32_t Version;   // +00 - 0x00000006
@@ -23,21 +25,124 @@ struct Dc6FrameHeader {
   uint32_t Length;    // +1c
 };
 
-class Sprite : public RcArray<Bitmap> {
+constexpr uint32_t Dc6HdrVer = 0x00000006;
+
+template<class Pix>
+class BasicSprite : public RcArray<BasicBitmap<Pix>> {
 public:
-  using RcArray::RcArray;
+  using RcArray<BasicBitmap<Pix>>::RcArray;
 
   constexpr size_t NDir() const noexcept { return NRow(); }
   constexpr size_t NFrm() const noexcept { return NCol(); }
 
-#ifdef BMP_ALPHA
-  void ReadDc6(const char* Path, const Palette& Pal);
-  void SaveDc6(const char* Path, const Palette& Pal);
-#else
+  // Mask: the color of transparent pixels, unused with alpha
   void ReadDc6(const char* Path, const Palette& Pal, uint32_t Mask = 0x000000);
   void SaveDc6(const char* Path, const Palette& Pal, int32_t Dc6OffsetY = 0, uint32_t Mask = 0x000000);
-#endif
+private:
+  using RcArray<BasicBitmap<Pix>>::NRow;
+  using RcArray<BasicBitmap<Pix>>::NCol;
+};
+
+using Sprite = BasicSprite<Pixel>;
+using SpriteA = BasicSprite<PixelA>;
+
+extern template class BasicSprite<Pixel>;
+extern template class BasicSprite<PixelA>;
+
+class CovSprite : public RcArray<Coverage> {
+public:
+  using RcArray::RcArray;
+
+  constexpr size_t NDir() const noexcept { return NRow(); }
+  constexpr size_t NFrm() const noexcept { return NCol(); }
+
+  // Colors are mapped back to coverage by their brightness
+  void ReadDc6(const char* Path, const Palette& Pal);
+  void SaveDc6(const char* Path, const CovLut& Lut, int32_t Dc6OffsetY = 0);
+  // Each frame is encoded with Ramps[Ramp[IDir][IFrm]]
+  void SaveDc6(const char* Path, const CovRamps& Ramps, int32_t Dc6OffsetY = 0);
+
+  RcArray<uint16_t> Ramp;
+private:
+  using RcArray::NRow;
+  using RcArray::NCol;
+};
+
+// Frames are kept as the palette indices of the DC6, so reading and saving
+// is a lossless RLE transcode
+class IdxSprite : public RcArray<IdxBitmap> {
+public:
+  using RcArray::RcArray;
+
+  constexpr size_t NDir() const noexcept { return NRow(); }
+  constexpr size_t NFrm() const noexcept { return NCol(); }
+
+  void ReadDc6(const char* Path);
+  void SaveDc6(const char* Path, int32_t Dc6OffsetY = 0);
+  // The frame whose header is at Offset, without reading the rest of the file
+  static IdxBitmap ReadFrame(const char* Path, uint32_t Offset);
 private:
   using RcArray::NRow;
   using RcArray::NCol;
 };
+
+// Writes a DC6 file one frame after another, the offset table is filled in
+// on Close. Frames are not kept, so they can be encoded elsewhere.
+class Dc6Writer {
+public:
+  void Open(const char* Path, size_t NDir, size_t NFrm);
+  // Rle: as produced by EncodeDc6, terminator included
+  void Put(uint32_t Width, uint32_t Height, int32_t OffsetY, string_view Rle);
+  void Close();
+private:
+  AutoFile File;
+  RcArray<uint32_t> Offs;
+  size_t Next{};
+  size_t FpOffs{};
+  size_t Fp{};
+};
+
+// Appends the RLE bytes of a frame to Out
+void EncodeDc6(string& Out, BitmapView<const uint8_t> Cov, const CovLut& Lut);
+
+// Reads only the header and the offset table up front; frames are decoded
+// as coverage on first use and the most recent ones are kept in an LRU cache
+class LazySprite {
+public:
+  void Open(const char* Path, const Palette& Pal, size_t Capacity = 4096);
+
+  constexpr size_t NDir() const noexcept { return Offs.NRow(); }
+  constexpr size_t NFrm() const noexcept { return Offs.NCol(); }
+
+  Dc6FrameHeader FrameHeader(size_t IDir, size_t IFrm);
+  // Valid until another Capacity frames have been decoded
+  const Coverage& Frame(size_t IDir, size_t IFrm);
+  // As palette indices, for their colors; not cached
+  IdxBitmap IdxFrame(size_t IDir, size_t IFrm);
+private:
+  AutoFile File;
+  RcArray<uint32_t> Offs;
+  array<uint8_t, 256> Lum{};
+  size_t Capacity{};
+  list<pair<size_t, Coverage>> Lru;
+  unordered_map<size_t, list<pair<size_t, Coverage>>::iterator> Map;
+};
+
+// A whole DC6 file held in memory; frames are accessed without decoding
+class Dc6View {
+public:
+  // Data must outlive the view
+  void Parse(string_view Data);
+
+  constexpr size_t NDir() const noexcept { return Hdr.NDir; }
+  constexpr size_t NFrm() const noexcept { return Hdr.NFrm; }
+  constexpr const Dc6Header& Header() const noexcept { return Hdr; }
+
+  uint32_t Offset(size_t IDir, size_t IFrm) const;
+  Dc6FrameHeader FrameHeader(size_t IDir, size_t IFrm) const;
+  // RLE bytes of a frame, without the 3-byte terminator
+  string_view FrameRle(size_t IDir, size_t IFrm) const;
+private:
+  string_view Data;
+  Dc6Header Hdr{};
+};
@@ -0,0 +1,208 @@
+#include "AutoFile.hpp"
+#include "FontTable.hpp"
+#include "Pipeline.hpp"
+#include "Usage.hpp"
+
+#include <filesystem>
+
+namespace fs = ::std::filesystem;
+
+namespace {
+  using CharSet = bitset<0x10000>;
+
+  constexpr size_t ChunkSize = 1 << 20;
+
+  enum class TextEnc : uint8_t {
+    Utf8,    // bytes that are not UTF-8 are taken as Latin-1
+    Utf16Le,
+    Utf16Be,
+    StrTbl,  // D2 string table
+  };
+
+  // A part of a file, scanned on its own
+  struct ScanJob {
+    const string* Buf;
+    TextEnc Enc;
+    size_t Beg; // sequences starting in [Beg, End) are scanned
+    size_t End;
+  };
+
+  template<class T>
+  T Load(const string& Buf, size_t Off) {
+    T Res;
+    memcpy(&Res, Buf.data() + Off, sizeof(T));
+    return Res;
+  }
+
+  constexpr bool IsCont(uint8_t Byte) { return (Byte & 0xc0) == 0x80; }
+
+  // Lim: end of the buffer, a sequence may run past End
+  void ScanUtf8(const uint8_t* Ptr, const uint8_t* End, const uint8_t* Lim, CharSet& Used) {
+    while (Ptr < End) {
+      auto c = (uint32_t) *Ptr;
+      if (c < 0x80) {
+        Used.set(c);
+        ++Ptr;
+      }
+      else if ((c & 0xe0) == 0xc0 && Lim - Ptr >= 2 && IsCont(Ptr[1]) && c >= 0xc2) {
+        Used.set((c & 0x1f) << 6 | (Ptr[1] & 0x3f));
+        Ptr += 2;
+      }
+      else if ((c & 0xf0) == 0xe0 && Lim - Ptr >= 3 && IsCont(Ptr[1]) && IsCont(Ptr[2])) {
+        auto Cp = (c & 0x0f) << 12 | (Ptr[1] & 0x3f) << 6 | (Ptr[2] & 0x3f);
+        if (Cp >= 0x800 && (Cp < 0xd800 || Cp > 0xdfff))
+          Used.set(Cp);
+        Ptr += 3;
+      }
+      else if ((c & 0xf8) == 0xf0 && Lim - Ptr >= 4 && IsCont(Ptr[1]) && IsCont(Ptr[2]) && IsCont(Ptr[3]))
+        Ptr += 4; // beyond the chars a TBL can hold
+      else {
+        Used.set(c);
+        ++Ptr;
+      }
+    }
+  }
+
+  // Surrogates are skipped, as the chars they make are beyond the TBL
+  void ScanUtf16(const uint8_t* Ptr, const uint8_t* End, bool BigEndian, CharSet& Used) {
+    for (; Ptr + 1 < End; Ptr += 2) {
+      auto Cu = BigEndian ? Ptr[0] << 8 | Ptr[1] : Ptr[1] << 8 | Ptr[0];
+      if (Cu < 0xd800 || Cu > 0xdfff)
+        Used.set(Cu);
+    }
+  }
+
+  constexpr size_t StrTblHdrSize = 21;
+  constexpr size_t StrTblNodeSize = 17;
+
+  // By the header, which tells the size of the file and of the node table
+  bool IsStrTbl(const string& Buf) {
+    if (Buf.size() < StrTblHdrSize || Load<uint32_t>(Buf, 17) != Buf.size())
+      return false;
+    auto NElem = (size_t) Load<uint16_t>(Buf, 2);
+    auto NNode = (size_t) Load<uint32_t>(Buf, 4);
+    return StrTblHdrSize + NElem * 2 + NNode * StrTblNodeSize <= Buf.size();
+  }
+
+  // Values of the used entries, keys are never displayed. Buf must pass
+  // IsStrTbl.
+  void ScanStrTbl(const string& Buf, const char* Path, CharSet& Used) {
+    auto NElem = (size_t) Load<uint16_t>(Buf, 2);
+    auto NNode = (size_t) Load<uint32_t>(Buf, 4);
+    auto NodeOff = StrTblHdrSize + NElem * 2;
+    auto Data = (const uint8_t*) Buf.data();
+    for (auto i = size_t{0}; i < NNode; ++i) {
+      auto Node = NodeOff + i * StrTblNodeSize;
+      if (!Buf[Node])
+        continue;
+      auto ValOff = (size_t) Load<uint32_t>(Buf, Node + 11);
+      auto ValLen = (size_t) Load<uint16_t>(Buf, Node + 15);
+      if (ValOff > Buf.size() || ValLen > Buf.size() - ValOff) {
+        Warn("String %zu of %s is out of the file", i, Path);
+        continue;
+      }
+      auto Beg = Data + ValOff;
+      auto End = find(Beg, Beg + ValLen, 0);
+      ScanUtf8(Beg, End, End, Used);
+    }
+  }
+
+  void ScanJobPart(const ScanJob& Job, const char* Path, CharSet& Used) {
+    auto Data = (const uint8_t*) Job.Buf->data();
+    switch (Job.Enc) {
+    case TextEnc::Utf8: {
+      // Continuation bytes belong to the sequence of the previous part
+      auto Beg = Data + Job.Beg;
+      if (Job.Beg)
+        for (auto n = 0; n < 3 && Beg < Data + Job.End && IsCont(*Beg); ++n)
+          ++Beg;
+      ScanUtf8(Beg, Data + Job.End, Data + Job.Buf->size(), Used);
+      break;
+    }
+    case TextEnc::Utf16Le:
+    case TextEnc::Utf16Be:
+      ScanUtf16(Data + Job.Beg, Data + Job.End, Job.Enc == TextEnc::Utf16Be, Used);
+      break;
+    case TextEnc::StrTbl:
+      ScanStrTbl(*Job.Buf, Path, Used);
+      break;
+    }
+  }
+
+  bool HasExt(const fs::path& Path, const char* Ext) {
+    auto S = Path.extension().string();
+    return S.size() == strlen(Ext) && equal(S.begin(), S.end(), Ext,
+      [](char a, char b) { return tolower((unsigned char) a) == b; });
+  }
+
+  // Files of the directories, in a stable order
+  void ListFiles(const vector<string>& Paths, vector<string>& Files) {
+    for (auto& Path : Paths) {
+      if (!fs::is_directory(Path)) {
+        Files.emplace_back(Path);
+        continue;
+      }
+      vector<string> Found;
+      for (auto& Ent : fs::recursive_directory_iterator(Path)) {
+        auto& P = Ent.path();
+        if (Ent.is_regular_file() && (HasExt(P, ".tbl") || HasExt(P, ".txt") || HasExt(P, ".json")))
+          Found.emplace_back(P.string());
+      }
+      sort(Found.begin(), Found.end());
+      Files.insert(Files.end(), Found.begin(), Found.end());
+    }
+  }
+}
+
+void CharUsage::Scan(const vector<string>& Paths, uint32_t NThread) {
+  vector<string> Files;
+  ListFiles(Paths, Files);
+  Scanned = Paths;
+  for (auto& File : Files)
+    if (find(Paths.begin(), Paths.end(), File) == Paths.end())
+      Scanned.emplace_back(File);
+  // Files are read first, then split into parts scanned in parallel
+  vector<string> Bufs(Files.size());
+  vector<ScanJob> Jobs;
+  vector<size_t> FileOf;
+  for (auto i = size_t{0}; i < Files.size(); ++i) {
+    auto& Buf = Bufs[i];
+    Buf = AutoFile(Files[i].c_str(), "rb").ReadAll();
+    auto Enc = TextEnc::Utf8;
+    auto Beg = size_t{0};
+    if (HasExt(Files[i], ".tbl"))
+      Enc = TextEnc::StrTbl;
+    else if (Buf.size() >= 2 && (uint8_t) Buf[0] == 0xff && (uint8_t) Buf[1] == 0xfe)
+      Enc = TextEnc::Utf16Le, Beg = 2;
+    else if (Buf.size() >= 2 && (uint8_t) Buf[0] == 0xfe && (uint8_t) Buf[1] == 0xff)
+      Enc = TextEnc::Utf16Be, Beg = 2;
+    else if (Buf.size() >= 3 && !memcmp(Buf.data(), "\xef\xbb\xbf", 3))
+      Beg = 3;
+    if (Enc == TextEnc::StrTbl) {
+      // Font TBLs share the extension, and may sit in the same directories
+      if (Buf.size() >= 4 && Load<uint32_t>(Buf, 0) == TblSign) {
+        Warn("%s is a font table, skipped", Files[i].c_str());
+        continue;
+      }
+      if (!IsStrTbl(Buf)) {
+        Warn("%s is not a string table, skipped", Files[i].c_str());
+        continue;
+      }
+      Jobs.push_back({&Buf, Enc, 0, Buf.size()});
+      FileOf.emplace_back(i);
+      continue;
+    }
+    // Parts of UTF-16 stay aligned to code units, as ChunkSize is even
+    for (auto Off = Beg; Off < Buf.size(); Off += ChunkSize) {
+      Jobs.push_back({&Buf, Enc, Off, min(Off + ChunkSize, Buf.size())});
+      FileOf.emplace_back(i);
+    }
+  }
+  mutex Mtx;
+  ParallelFor(Jobs.size(), NThread, [&](size_t i) {
+    CharSet Part;
+    ScanJobPart(Jobs[i], Files[FileOf[i]].c_str(), Part);
+    lock_guard<mutex> Lock(Mtx);
+    Used |= Part;
+  });
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include <bitset>
+
+// The chars used by the strings of a game, for subsetting a font
+class CharUsage {
+public:
+  // Paths: D2 string tables (.tbl), text exports in UTF-8 or UTF-16 (by
+  // BOM), or directories of them. Other .tbl files, such as font TBLs, are
+  // skipped with a warning. NThread: scanner threads, 0 for one per core.
+  void Scan(const vector<string>& Paths, uint32_t NThread = 0);
+
+  bool Has(uint16_t Ch) const noexcept { return Used[Ch]; }
+  size_t Count() const noexcept { return Used.count(); }
+  // The paths given to Scan, then the files found in their directories
+  const vector<string>& Inputs() const noexcept { return Scanned; }
+private:
+  bitset<0x10000> Used;
+  vector<string> Scanned;
+};
@@ -1,128 +1,109 @@
 #include "../Common/Common.hpp"
+#include "../Common/Config.hpp"
+#include "../Common/Diag.hpp"
 #include "../Common/Font.hpp"
+#include "../Common/Service.hpp"
 
-#include "rapidjson/document.h"
+#include <chrono>
+#include <thread>
 
-#include <vector>
-#include <iostream>
-#include <fstream>
-
-template<class T>
-T Parse(const char* S, const char* Desc) {
-  uintmax_t Res{};
-  while (*S) {
-    if (!isdigit(*S))
-      Abort("Failed to parse %s", Desc);
-    auto Tmp = Res * 10 + (*S++ & 0xf);
-    if (Tmp < Res)
-      Abort("Integer overflow when parsing %s", Desc);
-    Res = Tmp;
+// Rebuilds whenever the config, its palette or one of its faces changes,
+// until killed. Faces, the palette and glyph rasters stay loaded, so a
+// change of metrics or padding rasterizes nothing again. Errors are printed
+// and the next change is waited for.
+int Watch(const char* Config, const char* PreviewPath, const wstring& Text) {
+  FontService Svc;
+  for (;;) {
+    auto T0 = chrono::steady_clock::now();
+    auto St = Svc.Build(Config);
+    auto NMiss = Svc.Glyphs().Misses();
+    auto NHit = Svc.Glyphs().Hits();
+    if (St.Ok())
+      Svc.Diags().Print();
+    if (St.Ok() && PreviewPath)
+      St = Svc.Preview(Config, Text, PreviewPath);
+    auto Ms = chrono::duration<double, milli>(chrono::steady_clock::now() - T0).count();
+    if (St.Ok())
+      printf("Built in %.0f ms: %zu glyphs rasterized, %zu reused\n", Ms, NMiss, NHit);
+    else
+      fprintf(stderr, "[ERROR] %s\n", St.Error.c_str());
+    printf("Watching for changes...\n");
+    fflush(stdout);
+    while (!Svc.InputsChanged())
+      this_thread::sleep_for(chrono::milliseconds(250));
+    // Editors may save in several writes
+    this_thread::sleep_for(chrono::milliseconds(100));
   }
-  return Cast<T>(Res, "The %s is too large (%" PRIuMAX ")", Desc, Res);
 }
 
 int main(int NArg, char* Args[]) {
     string jsonname = "config.json";
-    if (NArg > 1) {
-        jsonname = Args[1];
-        fprintf(stdout, "%s specified.\n", Args[1]);
+    auto ArgIdx = 1;
+    if (NArg > ArgIdx && strcmp(Args[ArgIdx], "--watch")) {
+        jsonname = Args[ArgIdx++];
+        fprintf(stdout, "%s specified.\n", jsonname.c_str());
     };
-
-    // dirty open a file in main
-    ifstream in(jsonname, ios::in);
-    if (!in)
-    {
-        cerr << "Error opening file" << endl;
-        return EXIT_FAILURE;
+    auto Watching = NArg > ArgIdx && !strcmp(Args[ArgIdx], "--watch");
+    if (Watching) {
+      const char* PreviewPath = NArg > ArgIdx + 1 ? Args[ArgIdx + 1] : nullptr;
+      wstring Text;
+      if (PreviewPath) {
+        printf("Type the preview text below:\n");
+        for (auto Ch = (wchar_t) getwchar(); Ch != WEOF; Ch = (wchar_t) getwchar())
+          Text += Ch;
+        while (!Text.empty() && Text.back() == '\n')
+          Text.pop_back();
+      }
+      return Watch(jsonname.c_str(), PreviewPath, Text);
     }
-    istreambuf_iterator<char> beg(in), end;
-    string json(beg, end);
-    in.close();
 
-    // shitty json lib here
-    rapidjson::Document d;
-    d.Parse(json.c_str());
-
-    if (!d.HasMember("filename")) {
+    vector<FontConfig> Cfgs;
+    vector<unique_ptr<Font>> Fnts;
+    if (!ReadFamily(jsonname.c_str(), Cfgs, Fnts)) {
         fprintf(stderr, "Invalid json.\n");
         fprintf(stderr,
             "\n"
             "Create DC6 and TBL according to given font and codepoint range\n"
             "\n"
-            "Usage: %s **params moved to json**\n"
+            "Usage: %s [<Config>.json] [--watch [<Preview>.png]]\n"
             "Construct DC6 and TBL file using the specified font face and point size.\n"
+            "Several sizes are built at once when the json has a family list.\n"
+            "With --watch, rebuild whenever the json, its palette or its faces change,\n"
+            "and render the text of standard input to the preview image if given.\n"
             "Note: The font must be supported by FreeType.\n"
             "Use null as the palatte to encode as grayscale images.\n",
             Args[0]
         );
         return EXIT_FAILURE;
     }
-  Font Fnt;
-
-  auto FacePath = d["path"].GetString();
-  uint16_t Size = d["size"].GetInt();
-  auto HeightConstant = d["leadingfactor"].GetInt();
-  auto LnSpacingOff = d["LeadingOffset"].GetInt();
-  auto CapHeight = d["CapHeight"].GetInt();
-  auto OriginOffset = d["OriginOffset"].GetInt();
-  auto PalPath = d["pal"].GetString();
-  auto Dc6Path = d["dc6name"].GetString();
-  auto TblPath = d["tblname"].GetString();
-  int32_t GlobalDc6OffsetY = d["Dc6OffsetY"].GetInt();
-
-  // Build a list with your free-to-waste RAM
-  vector<uint16_t> glyphlist;
-
-  // Juse werk snippet for parsing ranges
-  const rapidjson::Value& h = d["ranges"];
-  for (rapidjson::Value::ConstValueIterator v_iter = h.Begin();
-      v_iter != h.End(); ++v_iter)
-  {
-      const rapidjson::Value& field = *v_iter;
-      for (rapidjson::Value::ConstMemberIterator m_iter = field.MemberBegin();
-          m_iter != field.MemberEnd(); ++m_iter)
-      {
-          auto start = m_iter->value[0].GetInt();
-          auto end = m_iter->value[1].GetInt();
-          for (auto i = (unsigned) start; i <= (unsigned) end; i++)
-              glyphlist.push_back(i);
-          break;
-      }
-  }
-
-  auto boolaa = d["aa"].GetBool(); // currently global AA
-  //int bg = d["bgColor"][0].GetInt();
-
-  printf("Preparing glyphs...\n");
-  Fnt.Size = Size;
-  Fnt.HeightConstant = HeightConstant;
-  Fnt.LnSpacingOff = LnSpacingOff;
-  Fnt.CapHeight = CapHeight;
-  Fnt.OriginOffset = OriginOffset;
-  Fnt.Faces.emplace_back(FacePath);
-  for (auto it = glyphlist.cbegin(); it != glyphlist.cend(); it++) {
-    uint16_t Ch = *it;
-    auto& G = Fnt.Glyphs[Ch];
-    G.reset(new FontGlyph);
-    G->Char = Ch;
-    G->AntiAliasing = boolaa;
-    G->Size = Size;
-    G->FaceIdx = 0;
-    G->HasBmp = false;
+  for (auto& Cfg : Cfgs) {
+    if (Cfg.PalPath != Cfgs[0].PalPath)
+      Abort("The sizes of a family should share one palette");
+    if (Cfg.LogPath != Cfgs[0].LogPath)
+      Abort("The sizes of a family should share one log");
+    if (Cfg.NUnused)
+      printf("%s: %zu chars are left out, as no string uses them\n", Cfg.Dc6Path.c_str(), Cfg.NUnused);
   }
-  printf("Rendering glyphs...\n");
-  Fnt.RenderGlyphs();
   printf("Reading palette...\n");
   Palette Pal;
-  Pal.ReadDat(PalPath);
-  printf("Dumping font...\n");
-  Sprite Spr;
-  FontTable Tbl;
-  Fnt.Dump(Spr, Tbl);
-  printf("Saving DC6...\n");
-  Spr.SaveDc6(Dc6Path, Pal, GlobalDc6OffsetY);
+  Pal.ReadDat(Cfgs[0].PalPath.c_str());
+  CovRamps Ramps(Pal);
+  printf("Rendering glyphs and saving DC6...\n");
+  vector<FontTable> Tbls(Cfgs.size());
+  vector<FontBuild> Builds;
+  for (auto i = size_t{0}; i < Cfgs.size(); ++i) {
+    // The sizes of a family report apart, by their DC6
+    if (Cfgs.size() > 1)
+      Fnts[i]->Diag = &Diags().Part(Cfgs[i].Dc6Path);
+    Builds.push_back({Fnts[i].get(), Cfgs[i].Dc6Path.c_str(), &Tbls[i], Cfgs[i].Dc6OffsetY});
+  }
+  Font::BuildFamily(Builds, Ramps, Cfgs[0].NThread);
+  Diags().Print();
+  if (!Cfgs[0].LogPath.empty())
+    Diags().SaveLog(Cfgs[0].LogPath.c_str());
   printf("Saving TBL...\n");
-  Tbl.SaveTbl(TblPath);
+  for (auto i = size_t{0}; i < Cfgs.size(); ++i)
+    Tbls[i].SaveTbl(Cfgs[i].TblPath.c_str());
   printf("All done\n");
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,144 @@
+#include "../Common/Common.hpp"
+#include "../Common/Service.hpp"
+#include "D2mfc.h"
+
+struct D2mfcService {
+  FontService Svc;
+  string Error;
+};
+
+struct D2mfcSprite {
+  IdxSprite Spr;
+};
+
+struct D2mfcTable {
+  FontTable Tbl;
+};
+
+namespace {
+  int Report(D2mfcService* Svc, Status&& St) {
+    Svc->Error = move(St.Error);
+    return Svc->Error.empty() ? 0 : -1;
+  }
+}
+
+D2mfcService* D2mfcCreate(void) {
+  try {
+    return new D2mfcService;
+  }
+  catch (...) {
+    return nullptr;
+  }
+}
+
+void D2mfcDestroy(D2mfcService* Svc) {
+  delete Svc;
+}
+
+int D2mfcBuild(D2mfcService* Svc, const char* ConfigPath) {
+  return Report(Svc, Svc->Svc.Build(ConfigPath));
+}
+
+int D2mfcPreview(D2mfcService* Svc, const char* ConfigPath, const uint16_t* Text, size_t Len,
+  const char* ImgPath) {
+  wstring Str;
+  try {
+    Str.assign(Text, Text + Len);
+  }
+  catch (...) {
+    return Report(Svc, {"Out of memory"});
+  }
+  return Report(Svc, Svc->Svc.Preview(ConfigPath, Str, ImgPath));
+}
+
+int D2mfcMeasure(D2mfcService* Svc, const char* TblPath, const uint16_t* Text, size_t Len,
+  uint32_t* W, uint32_t* H, size_t* Missing) {
+  auto NMissing = size_t{0};
+  auto Res = Report(Svc, Svc->Svc.Measure(TblPath, u16string_view((const char16_t*) Text, Len), *W, *H, NMissing));
+  if (Missing)
+    *Missing = NMissing;
+  return Res;
+}
+
+const char* D2mfcError(const D2mfcService* Svc) {
+  return Svc->Error.c_str();
+}
+
+void D2mfcClear(D2mfcService* Svc) {
+  Svc->Svc.Clear();
+}
+
+int D2mfcReadDc6(D2mfcService* Svc, const char* Path, D2mfcSprite** Spr) {
+  *Spr = nullptr;
+  unique_ptr<D2mfcSprite> New(new (nothrow) D2mfcSprite);
+  if (!New)
+    return Report(Svc, {"Out of memory"});
+  if (auto Res = Report(Svc, Svc->Svc.ReadDc6(Path, New->Spr)))
+    return Res;
+  *Spr = New.release();
+  return 0;
+}
+
+int D2mfcSaveDc6(D2mfcService* Svc, const char* Path, D2mfcSprite* Spr, int32_t Dc6OffsetY) {
+  return Report(Svc, Svc->Svc.SaveDc6(Path, Spr->Spr, Dc6OffsetY));
+}
+
+int D2mfcReadTbl(D2mfcService* Svc, const char* Path, D2mfcTable** Tbl) {
+  *Tbl = nullptr;
+  unique_ptr<D2mfcTable> New(new (nothrow) D2mfcTable);
+  if (!New)
+    return Report(Svc, {"Out of memory"});
+  if (auto Res = Report(Svc, Svc->Svc.ReadTbl(Path, New->Tbl)))
+    return Res;
+  *Tbl = New.release();
+  return 0;
+}
+
+int D2mfcSaveTbl(D2mfcService* Svc, const char* Path, D2mfcTable* Tbl) {
+  return Report(Svc, Svc->Svc.SaveTbl(Path, Tbl->Tbl));
+}
+
+void D2mfcFreeSprite(D2mfcSprite* Spr) {
+  delete Spr;
+}
+
+void D2mfcSpriteSize(const D2mfcSprite* Spr, size_t* NDir, size_t* NFrm) {
+  *NDir = Spr->Spr.NDir();
+  *NFrm = Spr->Spr.NFrm();
+}
+
+int D2mfcSpriteFrame(const D2mfcSprite* Spr, size_t IDir, size_t IFrm, uint32_t* W, uint32_t* H,
+  uint8_t* Idx, uint8_t* Opq) {
+  if (IDir >= Spr->Spr.NDir() || IFrm >= Spr->Spr.NFrm())
+    return -1;
+  auto& Bmp = Spr->Spr[IDir][IFrm];
+  *W = (uint32_t) Bmp.Width();
+  *H = (uint32_t) Bmp.Height();
+  for (auto i = size_t{0}; i < Bmp.Count(); ++i) {
+    if (Idx)
+      Idx[i] = Bmp.Raw()[i].Idx;
+    if (Opq)
+      Opq[i] = Bmp.Raw()[i].Opq;
+  }
+  return 0;
+}
+
+void D2mfcFreeTable(D2mfcTable* Tbl) {
+  delete Tbl;
+}
+
+size_t D2mfcTableInfo(const D2mfcTable* Tbl, uint8_t* LnSpacing, uint8_t* CapHeight) {
+  if (LnSpacing)
+    *LnSpacing = Tbl->Tbl.Hdr.LnSpacing;
+  if (CapHeight)
+    *CapHeight = Tbl->Tbl.Hdr.CapHeight;
+  return Tbl->Tbl.Hdr.NChar;
+}
+
+int D2mfcTableChar(const D2mfcTable* Tbl, size_t I, D2mfcTblChar* Chr) {
+  if (I >= Tbl->Tbl.Hdr.NChar)
+    return -1;
+  auto& C = Tbl->Tbl.Chrs[I];
+  *Chr = {C.Char, C.Width, C.Height, C.Dc6Index};
+  return 0;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+/* C interface of D2MFC for hosts that keep one process alive across many
+ * builds. Calls report failures by their return value instead of ending the
+ * process; palettes, faces and metrics stay loaded in the service between
+ * calls. Calls on one service must not overlap. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#ifdef D2MFC_EXPORTS
+#define D2MFC_API __declspec(dllexport)
+#else
+#define D2MFC_API __declspec(dllimport)
+#endif
+#else
+#define D2MFC_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct D2mfcService D2mfcService;
+/* A DC6 or a TBL as read, freed with D2mfcFreeSprite or D2mfcFreeTable */
+typedef struct D2mfcSprite D2mfcSprite;
+typedef struct D2mfcTable D2mfcTable;
+
+typedef struct D2mfcTblChar {
+  uint16_t Char;
+  uint8_t Width;
+  uint8_t Height;
+  uint16_t Dc6Index;
+} D2mfcTblChar;
+
+/* NULL if out of memory */
+D2MFC_API D2mfcService* D2mfcCreate(void);
+D2MFC_API void D2mfcDestroy(D2mfcService* Svc);
+
+/* The calls below return 0 on success and -1 on failure, the message of
+ * which stays readable through D2mfcError until the next call. */
+
+/* The DC6 and TBL of every size of a D2MFC config */
+D2MFC_API int D2mfcBuild(D2mfcService* Svc, const char* ConfigPath);
+/* Renders Len UTF-16 code units of Text with the face of a config into an
+ * image (PNG, PPM, PGM or QOI by extension, PNG without one) */
+D2MFC_API int D2mfcPreview(D2mfcService* Svc, const char* ConfigPath, const uint16_t* Text, size_t Len,
+  const char* ImgPath);
+/* Extent of Len UTF-16 code units of Text by the metrics of a TBL. Missing
+ * (may be NULL) gets the number of chars not in the TBL. */
+D2MFC_API int D2mfcMeasure(D2mfcService* Svc, const char* TblPath, const uint16_t* Text, size_t Len,
+  uint32_t* W, uint32_t* H, size_t* Missing);
+
+/* *Spr or *Tbl gets a new handle on success, NULL on failure */
+D2MFC_API int D2mfcReadDc6(D2mfcService* Svc, const char* Path, D2mfcSprite** Spr);
+D2MFC_API int D2mfcSaveDc6(D2mfcService* Svc, const char* Path, D2mfcSprite* Spr, int32_t Dc6OffsetY);
+D2MFC_API int D2mfcReadTbl(D2mfcService* Svc, const char* Path, D2mfcTable** Tbl);
+D2MFC_API int D2mfcSaveTbl(D2mfcService* Svc, const char* Path, D2mfcTable* Tbl);
+
+/* Message of the last failed call, empty after a success */
+D2MFC_API const char* D2mfcError(const D2mfcService* Svc);
+/* Drops what is kept loaded */
+D2MFC_API void D2mfcClear(D2mfcService* Svc);
+
+D2MFC_API void D2mfcFreeSprite(D2mfcSprite* Spr);
+D2MFC_API void D2mfcSpriteSize(const D2mfcSprite* Spr, size_t* NDir, size_t* NFrm);
+/* Size of a frame, and its palette indices and opacities (0: transparent)
+ * row by row into Idx and Opq of W * H bytes each, when not NULL. -1 if
+ * there is no such frame. */
+D2MFC_API int D2mfcSpriteFrame(const D2mfcSprite* Spr, size_t IDir, size_t IFrm, uint32_t* W, uint32_t* H,
+  uint8_t* Idx, uint8_t* Opq);
+
+D2MFC_API void D2mfcFreeTable(D2mfcTable* Tbl);
+/* Number of chars; LnSpacing and CapHeight may be NULL */
+D2MFC_API size_t D2mfcTableInfo(const D2mfcTable* Tbl, uint8_t* LnSpacing, uint8_t* CapHeight);
+/* -1 if I is not below the number of chars */
+D2MFC_API int D2mfcTableChar(const D2mfcTable* Tbl, size_t I, D2mfcTblChar* Chr);
+
+#ifdef __cplusplus
+}
+#endif
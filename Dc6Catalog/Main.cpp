@@ -0,0 +1,293 @@
+#include "../Common/Common.hpp"
+#include "../Common/AutoFile.hpp"
+#include "../Common/MappedFile.hpp"
+#include "../Common/Pipeline.hpp"
+#include "../Common/Sprite.hpp"
+
+#include <chrono>
+#include <filesystem>
+
+namespace fs = ::std::filesystem;
+
+namespace {
+  constexpr uint32_t CatSign = 0x54433644; // D6CT
+  constexpr uint32_t CatVer = 1;
+
+  // The index is the header, the files sorted by path, the frames of each
+  // file in the order of its offset table, then the paths. Records are
+  // 8-byte aligned, so a mapped index is read in place.
+  struct CatHeader {
+    uint32_t Sign;    // +00 - CatSign
+    uint32_t Version; // +04 - CatVer
+    uint32_t NFile;   // +08
+    uint32_t NFrame;  // +0c
+    uint64_t Names;   // +10 - offset of the paths, each ends with a '\0'
+    uint64_t Unused;  // +18 - 0x0000000000000000
+  };
+
+  struct CatFile {
+    uint64_t Name;    // +00 - offset of the path among the paths
+    uint64_t Size;    // +08 - of the DC6 file
+    uint32_t NDir;    // +10
+    uint32_t NFrm;    // +14 - frames per direction
+    uint32_t Frame;   // +18 - first of its NDir * NFrm frames
+    uint32_t MaxW;    // +1c - of its frames
+    uint32_t MaxH;    // +20
+    uint32_t Unused;  // +24 - 0x00000000
+  };
+
+  struct CatFrame {
+    uint32_t File;    // +00
+    uint32_t Offset;  // +04 - of the frame header in the DC6 file
+    uint32_t Width;   // +08
+    uint32_t Height;  // +0c
+    int32_t OffsetX;  // +10
+    int32_t OffsetY;  // +14
+    uint32_t Length;  // +18 - of the RLE bytes
+    uint32_t Flip;    // +1c
+  };
+
+  static_assert(sizeof(CatHeader) == 0x20 && sizeof(CatFile) == 0x28 && sizeof(CatFrame) == 0x20);
+
+  bool IsDc6(const fs::path& Path) {
+    auto Ext = Path.extension().string();
+    return Ext.size() == 4 && Ext[0] == '.' && tolower(Ext[1]) == 'd' && tolower(Ext[2]) == 'c' && Ext[3] == '6';
+  }
+
+  struct Entry {
+    CatFile File{};
+    vector<CatFrame> Frames;
+    string Error; // the file is left out if not empty
+  };
+
+  // Only the headers and the offset table are read, no frame is decoded
+  void ReadEntry(const string& Path, Entry& E) {
+    auto File = AutoFile(Path.c_str(), "rb");
+    auto Size = File.Size();
+    auto Hdr = File.Get<Dc6Header>();
+    if (Hdr.Version != Dc6HdrVer)
+      Abort("DC6 file should start with %.8x instead of %.8x", Dc6HdrVer, Hdr.Version);
+    auto NOff = (uint64_t) Hdr.NDir * Hdr.NFrm;
+    if (sizeof(Dc6Header) + NOff * sizeof(uint32_t) > Size)
+      Abort("DC6 offset table (%" PRIu64 " entries) exceeds the file size (%zu bytes)", NOff, Size);
+    vector<uint32_t> Offs((size_t) NOff);
+    File.Get(Offs.data(), Offs.size());
+    E.File = {0, Size, Hdr.NDir, Hdr.NFrm, 0, 0, 0, 0};
+    for (auto Off : Offs) {
+      if ((uint64_t) Off + sizeof(Dc6FrameHeader) > Size)
+        Abort("Frame at %u exceeds the file size (%zu bytes)", Off, Size);
+      auto Frm = File.GetAt<Dc6FrameHeader>(Off);
+      if ((uint64_t) Off + sizeof(Dc6FrameHeader) + Frm.Length > Size)
+        Abort("Frame at %u of %u bytes exceeds the file size (%zu bytes)", Off, Frm.Length, Size);
+      E.Frames.push_back({0, Off, Frm.Width, Frm.Height, Frm.OffsetX, Frm.OffsetY, Frm.Length, Frm.Flip});
+      E.File.MaxW = max(E.File.MaxW, Frm.Width);
+      E.File.MaxH = max(E.File.MaxH, Frm.Height);
+    }
+  }
+
+  void Build(const char* Root, const char* IdxPath, uint32_t NThread) {
+    auto T0 = chrono::steady_clock::now();
+    vector<string> Paths;
+    for (auto& It : fs::recursive_directory_iterator(Root, fs::directory_options::skip_permission_denied))
+      if (It.is_regular_file() && IsDc6(It.path()))
+        Paths.emplace_back(It.path().generic_string());
+    sort(Paths.begin(), Paths.end());
+    // A broken file is reported and left out, instead of ending the build
+    vector<Entry> Entries(Paths.size());
+    SetAbortThrows(true);
+    ParallelFor(Paths.size(), NThread, [&](size_t i) {
+      try {
+        ReadEntry(Paths[i], Entries[i]);
+      }
+      catch (const AbortError& E) {
+        Entries[i].Error = E.what();
+        Entries[i].Frames.clear();
+      }
+    });
+    SetAbortThrows(false);
+
+    vector<CatFile> Files;
+    vector<CatFrame> Frames;
+    string Names;
+    for (auto i = size_t{0}; i < Paths.size(); ++i) {
+      auto& E = Entries[i];
+      if (!E.Error.empty()) {
+        Warn("Skipped %s: %s", Paths[i].c_str(), E.Error.c_str());
+        continue;
+      }
+      auto IFile = Cast<uint32_t>(Files.size(), "Too many files (%zu)", Files.size());
+      E.File.Name = Names.size();
+      E.File.Frame = Cast<uint32_t>(Frames.size(), "Too many frames (%zu)", Frames.size());
+      Names.append(Paths[i]).push_back('\0');
+      Files.emplace_back(E.File);
+      for (auto& Frm : E.Frames) {
+        Frm.File = IFile;
+        Frames.emplace_back(Frm);
+      }
+    }
+    CatHeader Hdr;
+    Hdr.Sign = CatSign;
+    Hdr.Version = CatVer;
+    Hdr.NFile = (uint32_t) Files.size();
+    Hdr.NFrame = Cast<uint32_t>(Frames.size(), "Too many frames (%zu)", Frames.size());
+    Hdr.Names = sizeof(CatHeader) + sizeof(CatFile) * Files.size() + sizeof(CatFrame) * Frames.size();
+    Hdr.Unused = 0;
+    auto File = AutoFile(IdxPath, "wb");
+    File.Put(Hdr);
+    File.Put(Files.data(), Files.size());
+    File.Put(Frames.data(), Frames.size());
+    File.Put(Names.data(), Names.size());
+    auto Ms = chrono::duration<double, milli>(chrono::steady_clock::now() - T0).count();
+    printf("%zu files, %zu frames indexed in %.0f ms, %zu skipped\n",
+      Files.size(), Frames.size(), Ms, Paths.size() - Files.size());
+  }
+
+  // An index mapped as it is
+  class Catalog {
+  public:
+    explicit Catalog(const char* Path) : Idx(Path) {
+      if (Idx.Size() < sizeof(CatHeader))
+        Abort("Index file is too small (%zu bytes)", Idx.Size());
+      auto& H = Hdr();
+      if (H.Sign != CatSign)
+        Abort("Index file should start with %.8x instead of %.8x", CatSign, H.Sign);
+      if (H.Version != CatVer)
+        Abort("Index version should be %u instead of %u", CatVer, H.Version);
+      if (H.Names != sizeof(CatHeader) + sizeof(CatFile) * H.NFile + sizeof(CatFrame) * H.NFrame || H.Names > Idx.Size())
+        Abort("Index file is truncated");
+      if (H.NFile && Idx.Data()[Idx.Size() - 1])
+        Abort("Index file is truncated");
+      for (auto i = 0u; i < H.NFile; ++i) {
+        auto& F = Files()[i];
+        if (F.Name >= Idx.Size() - H.Names || (uint64_t) F.Frame + (uint64_t) F.NDir * F.NFrm > H.NFrame)
+          Abort("File %u of the index is out of range", i);
+      }
+    }
+
+    const CatHeader& Hdr() const noexcept { return *(const CatHeader*) Idx.Data(); }
+    const CatFile* Files() const noexcept { return (const CatFile*) (Idx.Data() + sizeof(CatHeader)); }
+    const CatFrame* Frames() const noexcept { return (const CatFrame*) (Files() + Hdr().NFile); }
+    const char* Name(const CatFile& F) const noexcept { return (const char*) Idx.Data() + Hdr().Names + F.Name; }
+
+    // Files are sorted by path
+    const CatFile* Find(const char* Path) const {
+      auto Beg = Files(), End = Files() + Hdr().NFile;
+      auto It = lower_bound(Beg, End, Path, [&](const CatFile& F, const char* P) { return strcmp(Name(F), P) < 0; });
+      return It != End && !strcmp(Name(*It), Path) ? It : nullptr;
+    }
+  private:
+    MappedFile Idx;
+  };
+
+  struct Filter {
+    const char* Name{};
+    uint32_t NDir{}, NFrm{}; // 0: any
+    uint32_t MinW{}, MaxW{UINT32_MAX}, MinH{}, MaxH{UINT32_MAX};
+    bool List{};
+
+    bool FramesOnly() const noexcept { return MinW || MinH || MaxW != UINT32_MAX || MaxH != UINT32_MAX; }
+  };
+
+  void Query(const char* IdxPath, const Filter& Flt) {
+    auto T0 = chrono::steady_clock::now();
+    Catalog Cat(IdxPath);
+    auto NFile = size_t{0}, NFrame = size_t{0};
+    vector<uint32_t> Hits;
+    for (auto i = 0u; i < Cat.Hdr().NFile; ++i) {
+      auto& F = Cat.Files()[i];
+      if ((Flt.NDir && F.NDir != Flt.NDir) || (Flt.NFrm && F.NFrm != Flt.NFrm))
+        continue;
+      if (Flt.Name && !strstr(Cat.Name(F), Flt.Name))
+        continue;
+      Hits.clear();
+      for (auto j = 0u; j < F.NDir * F.NFrm; ++j) {
+        auto& Frm = Cat.Frames()[F.Frame + j];
+        if (Frm.Width >= Flt.MinW && Frm.Width <= Flt.MaxW && Frm.Height >= Flt.MinH && Frm.Height <= Flt.MaxH)
+          Hits.emplace_back(j);
+      }
+      if (Hits.empty() && Flt.FramesOnly())
+        continue;
+      ++NFile;
+      NFrame += Hits.size();
+      printf("%s: %ux%u frames, up to %ux%u, %zu bytes\n", Cat.Name(F), F.NDir, F.NFrm, F.MaxW, F.MaxH, (size_t) F.Size);
+      if (Flt.List)
+        for (auto j : Hits) {
+          auto& Frm = Cat.Frames()[F.Frame + j];
+          printf("  %u-%u: %ux%u at (%d,%d), %u RLE bytes at %u\n", j / F.NFrm, j % F.NFrm,
+            Frm.Width, Frm.Height, Frm.OffsetX, Frm.OffsetY, Frm.Length, Frm.Offset);
+        }
+    }
+    auto Ms = chrono::duration<double, milli>(chrono::steady_clock::now() - T0).count();
+    printf("%zu of %u files, %zu frames match (%.1f ms)\n", NFile, Cat.Hdr().NFile, NFrame, Ms);
+  }
+
+  void Extract(const char* IdxPath, const char* Path, uint32_t IDir, uint32_t IFrm, const char* PalPath, const char* OutPath) {
+    Catalog Cat(IdxPath);
+    auto F = Cat.Find(Path);
+    if (!F)
+      Abort("%s is not in the index", Path);
+    if (IDir >= F->NDir || IFrm >= F->NFrm)
+      Abort("Frame (%u,%u) is out of range (%ux%u)", IDir, IFrm, F->NDir, F->NFrm);
+    Palette Pal;
+    Pal.ReadDat(PalPath);
+    auto& Frm = Cat.Frames()[F->Frame + IDir * F->NFrm + IFrm];
+    IdxSprite::ReadFrame(Path, Frm.Offset).Save(OutPath, Pal);
+  }
+}
+
+int main(int NArg, char* Args[]) {
+  auto Mode = NArg > 1 ? string_view(Args[1]) : string_view();
+  if (!((Mode == "build" && (NArg == 4 || NArg == 5)) || (Mode == "query" && NArg >= 3) || (Mode == "extract" && NArg == 8))) {
+    fprintf(stderr, "Incorrect command line.\n");
+    fprintf(stderr,
+      "\n"
+      "Catalog DC6 Files\n"
+      "\n"
+      "Usage: %s build <Dir> <Out>.idx [Threads]\n"
+      "       %s query <In>.idx [--name <Text>] [--dirs <N>] [--frames <N>]\n"
+      "           [--min-w <W>] [--max-w <W>] [--min-h <H>] [--max-h <H>] [--list]\n"
+      "       %s extract <In>.idx <File>.dc6 <Dir> <Frame> <Palette>.dat <Out>.png\n"
+      "build: index the DC6 files under a directory, reading only their headers.\n"
+      "query: list the files whose path has Text, with N directions or N frames\n"
+      "per direction, and with frames within the sizes; --list the frames.\n"
+      "extract: decode one frame of a file of the index, as its path is listed.\n",
+      Args[0], Args[0], Args[0]
+    );
+    return EXIT_FAILURE;
+  }
+  if (Mode == "build")
+    Build(Args[2], Args[3], NArg == 5 ? Parse<uint32_t>(Args[4], "Threads") : 0u);
+  else if (Mode == "extract")
+    Extract(Args[2], Args[3], Parse<uint32_t>(Args[4], "Dir"), Parse<uint32_t>(Args[5], "Frame"), Args[6], Args[7]);
+  else {
+    Filter Flt;
+    for (auto i = 3; i < NArg; ++i) {
+      auto Opt = string_view(Args[i]);
+      if (Opt == "--list") {
+        Flt.List = true;
+        continue;
+      }
+      if (i + 1 == NArg)
+        Abort("%s should be followed by a value", Args[i]);
+      auto Val = Args[++i];
+      if (Opt == "--name")
+        Flt.Name = Val;
+      else if (Opt == "--dirs")
+        Flt.NDir = Parse<uint32_t>(Val, Args[i - 1]);
+      else if (Opt == "--frames")
+        Flt.NFrm = Parse<uint32_t>(Val, Args[i - 1]);
+      else if (Opt == "--min-w")
+        Flt.MinW = Parse<uint32_t>(Val, Args[i - 1]);
+      else if (Opt == "--max-w")
+        Flt.MaxW = Parse<uint32_t>(Val, Args[i - 1]);
+      else if (Opt == "--min-h")
+        Flt.MinH = Parse<uint32_t>(Val, Args[i - 1]);
+      else if (Opt == "--max-h")
+        Flt.MaxH = Parse<uint32_t>(Val, Args[i - 1]);
+      else
+        Abort("Unknown option %s", Args[i - 1]);
+    }
+    Query(Args[2], Flt);
+  }
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,124 @@
+#include "../Common/Common.hpp"
+#include "../Common/AutoFile.hpp"
+#include "../Common/FontTable.hpp"
+#include "../Common/Sprite.hpp"
+
+namespace {
+  struct CharSig {
+    TblChar Chr;
+    uint64_t Bmp; // frame header and RLE bytes
+  };
+
+  struct FontSig {
+    string Dc6;
+    Dc6View Spr;
+    FontTable Tbl;
+    vector<CharSig> Sigs;
+
+    void Read(const char* Dc6Path, const char* TblPath) {
+      Dc6 = AutoFile(Dc6Path, "rb").ReadAll();
+      Spr.Parse(Dc6);
+      Tbl.ReadTbl(TblPath);
+      if (Spr.NDir() != 1)
+        Abort("The number of directions should be 1 instead of %zu", Spr.NDir());
+      vector<uint64_t> Frms(Spr.NFrm());
+      for (auto i = 0u; i < Spr.NFrm(); ++i) {
+        auto Frm = Spr.FrameHeader(0, i);
+        Frm.NextBlock = 0; // depends on the preceding frames only
+        auto Rle = Spr.FrameRle(0, i);
+        Frms[i] = Fnv1a(Rle.data(), Rle.size(), Fnv1a(&Frm, sizeof(Frm)));
+      }
+      Sigs.resize(Tbl.Hdr.NChar);
+      for (auto i = 0u; i < Tbl.Hdr.NChar; ++i) {
+        auto& C = Tbl.Chrs[i];
+        if (C.Dc6Index >= Frms.size())
+          Abort("DC6 index (%u) is too large for char (%u): should be less than %zu", C.Dc6Index, C.Char, Frms.size());
+        Sigs[i] = {C, Frms[C.Dc6Index]};
+      }
+      stable_sort(Sigs.begin(), Sigs.end(),
+        [](const CharSig& A, const CharSig& B) { return A.Chr.Char < B.Chr.Char; }
+      );
+    }
+  };
+
+  // As diff and cmp, so that scripts can tell a change from a failure
+  constexpr int ExitSame = 0;
+  constexpr int ExitDiff = 1;
+  constexpr int ExitError = 2;
+
+  bool SameMetrics(const TblChar& A, const TblChar& B) {
+    return A.UnkCZ1 == B.UnkCZ1 && A.Width == B.Width && A.Height == B.Height &&
+      A.UnkTwo == B.UnkTwo && A.UnkCZ2 == B.UnkCZ2;
+  }
+}
+
+int main(int NArg, char* Args[]) {
+  if (NArg != 5) {
+    fprintf(stderr, "Incorrect command line.\n");
+    fprintf(stderr,
+      "\n"
+      "Compare Fonts\n"
+      "\n"
+      "Usage: %s <Old>.dc6 <Old>.tbl <New>.dc6 <New>.tbl\n"
+      "Report the chars whose bitmaps or metrics differ between two fonts.\n"
+      "Frames are compared by hashing their encoded bytes, nothing is decoded.\n"
+      "Exit code is 0 if the fonts are identical, 1 if they differ and 2 if\n"
+      "they could not be compared.\n",
+      Args[0]
+    );
+    return ExitError;
+  }
+  FontSig Old, New;
+  SetAbortThrows(true);
+  try {
+    Old.Read(Args[1], Args[2]);
+    New.Read(Args[3], Args[4]);
+  }
+  catch (const AbortError& E) {
+    fprintf(stderr, "[ABORT] %s\n", E.what());
+    return ExitError;
+  }
+  SetAbortThrows(false);
+  auto NDiff = 0u;
+  auto& OH = Old.Tbl.Hdr;
+  auto& NH = New.Tbl.Hdr;
+  if (OH.LnSpacing != NH.LnSpacing || OH.CapHeight != NH.CapHeight || OH.UnkHZ != NH.UnkHZ) {
+    printf("* header: LnSpacing %u->%u CapHeight %u->%u UnkHZ %u->%u\n",
+      OH.LnSpacing, NH.LnSpacing, OH.CapHeight, NH.CapHeight, OH.UnkHZ, NH.UnkHZ);
+    ++NDiff;
+  }
+  auto NAdd = 0u, NDel = 0u, NBmp = 0u, NMet = 0u;
+  auto i = size_t{0}, j = size_t{0};
+  while (i < Old.Sigs.size() || j < New.Sigs.size()) {
+    if (j == New.Sigs.size() || (i < Old.Sigs.size() && Old.Sigs[i].Chr.Char < New.Sigs[j].Chr.Char)) {
+      printf("- U+%04X\n", Old.Sigs[i++].Chr.Char);
+      ++NDel;
+      continue;
+    }
+    if (i == Old.Sigs.size() || New.Sigs[j].Chr.Char < Old.Sigs[i].Chr.Char) {
+      printf("+ U+%04X\n", New.Sigs[j++].Chr.Char);
+      ++NAdd;
+      continue;
+    }
+    auto& O = Old.Sigs[i++];
+    auto& N = New.Sigs[j++];
+    auto BmpDiff = O.Bmp != N.Bmp;
+    auto MetDiff = !SameMetrics(O.Chr, N.Chr);
+    if (!BmpDiff && !MetDiff)
+      continue;
+    printf("* U+%04X", O.Chr.Char);
+    if (BmpDiff) {
+      printf(" bitmap");
+      ++NBmp;
+    }
+    if (MetDiff) {
+      printf(" metrics: Width %u->%u Height %u->%u UnkTwo %u->%u",
+        O.Chr.Width, N.Chr.Width, O.Chr.Height, N.Chr.Height, O.Chr.UnkTwo, N.Chr.UnkTwo);
+      ++NMet;
+    }
+    putchar('\n');
+  }
+  NDiff += NAdd + NDel + NBmp + NMet;
+  printf("%u added, %u removed, %u bitmaps changed, %u metrics changed\n", NAdd, NDel, NBmp, NMet);
+  return NDiff ? ExitDiff : ExitSame;
+}
\ No newline at end of file
@@ -0,0 +1,393 @@
+#include "../Common/Common.hpp"
+#include "../Common/AutoFile.hpp"
+#include "../Common/FontTable.hpp"
+#include "../Common/Sprite.hpp"
+
+#include <zlib.h>
+
+namespace {
+  constexpr uint32_t PatchSign = 0x50364344; // DC6P
+  constexpr uint32_t PatchVer = 1;
+
+  struct PatchHeader {
+    uint32_t Sign;     // +00 - PatchSign
+    uint32_t Version;  // +04 - PatchVer
+    uint64_t OldDc6;   // +08 - hashes of the files the patch applies to
+    uint64_t OldTbl;   // +10
+    uint64_t NewDc6;   // +18 - and of the files it makes
+    uint64_t NewTbl;   // +20
+    uint32_t BodySize; // +28 - of the body once inflated
+    uint32_t Unused;   // +2c - 0x00000000
+  };
+
+  // The deflated body holds the new Dc6Header, an op for each run of new
+  // frames, the size and bytes of what follows the last frame, the new
+  // TblHeader and an op for each run of new rows. Old frames and rows that
+  // no op copies are dropped.
+  enum : uint8_t {
+    OpCopyFrames, // uint32_t First, Count: old frames from First on
+    OpFrame,      // Dc6FrameHeader, then Length + 3 bytes: a frame not in the old DC6
+    OpCopyRows,   // uint32_t First, Count, int32_t Shift: old rows from First on, Dc6Index moved by Shift
+    OpRow,        // TblChar: a row not in the old TBL
+  };
+
+  // Frames of a DC6, each with its header and its terminator. NextBlock is
+  // not compared, as it only follows from the preceding frames.
+  struct Dc6Frames {
+    Dc6Header Hdr{};
+    vector<string_view> Blocks;
+    string_view Tail;
+
+    void Parse(const string& Data) {
+      Dc6View View;
+      View.Parse(Data);
+      Hdr = View.Header();
+      auto End = sizeof(Dc6Header) + sizeof(uint32_t) * View.NDir() * View.NFrm();
+      for (auto IDir = size_t{0}; IDir < View.NDir(); ++IDir)
+        for (auto IFrm = size_t{0}; IFrm < View.NFrm(); ++IFrm) {
+          auto Off = (size_t) View.Offset(IDir, IFrm);
+          auto Size = sizeof(Dc6FrameHeader) + View.FrameHeader(IDir, IFrm).Length + 3;
+          if (Off + Size > Data.size())
+            Abort("Frame (%zu,%zu) has no room for its terminator", IDir, IFrm);
+          Blocks.emplace_back(Data.data() + Off, Size);
+          End = max(End, Off + Size);
+        }
+      Tail = string_view(Data).substr(End);
+    }
+
+    static uint64_t Hash(string_view Block) {
+      auto Skip = offsetof(Dc6FrameHeader, NextBlock);
+      auto Rest = Skip + sizeof(uint32_t);
+      return Fnv1a(Block.data() + Rest, Block.size() - Rest, Fnv1a(Block.data(), Skip));
+    }
+
+    static bool Same(string_view A, string_view B) {
+      auto Skip = offsetof(Dc6FrameHeader, NextBlock);
+      auto Rest = Skip + sizeof(uint32_t);
+      return A.size() == B.size() && !memcmp(A.data(), B.data(), Skip) && A.substr(Rest) == B.substr(Rest);
+    }
+  };
+
+  // Rows are read as they are, unlike FontTable::ReadTbl which sorts them
+  struct TblRows {
+    TblHeader Hdr{};
+    vector<TblChar> Rows;
+
+    void Parse(const string& Data) {
+      if (Data.size() < sizeof(TblHeader))
+        Abort("TBL file is too small (%zu bytes)", Data.size());
+      memcpy(&Hdr, Data.data(), sizeof(TblHeader));
+      if (Hdr.Sign != TblSign)
+        Abort("TBL file should start with %.8x instead of %.8x", TblSign, Hdr.Sign);
+      if (Data.size() != sizeof(TblHeader) + sizeof(TblChar) * Hdr.NChar)
+        Abort("TBL file of %u chars should be %zu bytes instead of %zu", Hdr.NChar,
+          sizeof(TblHeader) + sizeof(TblChar) * Hdr.NChar, Data.size());
+      Rows.resize(Hdr.NChar);
+      memcpy(Rows.data(), Data.data() + sizeof(TblHeader), sizeof(TblChar) * Hdr.NChar);
+    }
+
+    static bool Same(TblChar Old, const TblChar& New, int32_t Shift) {
+      Old.Dc6Index = (uint16_t) (Old.Dc6Index + Shift);
+      return !memcmp(&Old, &New, sizeof(TblChar));
+    }
+  };
+
+  template<class T>
+  void Append(string& Out, const T& Obj) {
+    Out.append((const char*) &Obj, sizeof(T));
+  }
+
+  class BodyReader {
+  public:
+    explicit BodyReader(string_view Data) : Data(Data) {}
+
+    template<class T>
+    T Get() {
+      T Res;
+      memcpy(&Res, Bytes(sizeof(T)).data(), sizeof(T));
+      return Res;
+    }
+
+    string_view Bytes(size_t Size) {
+      if (Size > Data.size() - Pos)
+        Abort("The patch is truncated");
+      auto Res = Data.substr(Pos, Size);
+      Pos += Size;
+      return Res;
+    }
+
+    bool AtEnd() const noexcept { return Pos == Data.size(); }
+  private:
+    string_view Data;
+    size_t Pos{};
+  };
+
+  struct Stats {
+    size_t FrmCopied{}, FrmWritten{}, FrmDropped{};
+    size_t RowCopied{}, RowWritten{}, RowDropped{};
+  };
+
+  string MakeBody(const Dc6Frames& OldSpr, const TblRows& OldTbl, const Dc6Frames& NewSpr, const TblRows& NewTbl, Stats& St) {
+    string Body;
+    Append(Body, NewSpr.Hdr);
+    unordered_multimap<uint64_t, uint32_t> OldFrms;
+    for (auto i = size_t{0}; i < OldSpr.Blocks.size(); ++i)
+      OldFrms.emplace(Dc6Frames::Hash(OldSpr.Blocks[i]), (uint32_t) i);
+    vector<bool> FrmUsed(OldSpr.Blocks.size());
+    uint32_t First = 0, Count = 0;
+    auto FlushFrames = [&] {
+      if (!Count)
+        return;
+      Append(Body, OpCopyFrames);
+      Append(Body, First);
+      Append(Body, Count);
+      Count = 0;
+    };
+    for (auto& Blk : NewSpr.Blocks) {
+      auto Next = (size_t) First + Count;
+      if (Count && Next < OldSpr.Blocks.size() && Dc6Frames::Same(OldSpr.Blocks[Next], Blk)) {
+        FrmUsed[Next] = true;
+        ++Count;
+        continue;
+      }
+      FlushFrames();
+      // Frames that are alike, such as dummy ones, are taken in order
+      auto [Beg, End] = OldFrms.equal_range(Dc6Frames::Hash(Blk));
+      auto Res = End;
+      auto Rank = [&](auto It) { return pair(FrmUsed[It->second], It->second); };
+      for (auto It = Beg; It != End; ++It)
+        if (Dc6Frames::Same(OldSpr.Blocks[It->second], Blk) && (Res == End || Rank(It) < Rank(Res)))
+          Res = It;
+      if (Res != End) {
+        First = Res->second;
+        Count = 1;
+        FrmUsed[First] = true;
+        continue;
+      }
+      Append(Body, OpFrame);
+      Body.append(Blk);
+      ++St.FrmWritten;
+    }
+    FlushFrames();
+    St.FrmCopied = NewSpr.Blocks.size() - St.FrmWritten;
+    St.FrmDropped = (size_t) count(FrmUsed.begin(), FrmUsed.end(), false);
+    Append(Body, Cast<uint32_t>(NewSpr.Tail.size(), "The new DC6 has too much after its frames (%zu bytes)", NewSpr.Tail.size()));
+    Body.append(NewSpr.Tail);
+
+    Append(Body, NewTbl.Hdr);
+    unordered_map<uint16_t, uint32_t> OldRows;
+    for (auto i = size_t{0}; i < OldTbl.Rows.size(); ++i)
+      OldRows[OldTbl.Rows[i].Char] = (uint32_t) i;
+    vector<bool> RowUsed(OldTbl.Rows.size());
+    int32_t Shift = 0;
+    auto FlushRows = [&] {
+      if (!Count)
+        return;
+      Append(Body, OpCopyRows);
+      Append(Body, First);
+      Append(Body, Count);
+      Append(Body, Shift);
+      Count = 0;
+    };
+    for (auto& Row : NewTbl.Rows) {
+      auto Next = (size_t) First + Count;
+      if (Count && Next < OldTbl.Rows.size() && TblRows::Same(OldTbl.Rows[Next], Row, Shift)) {
+        RowUsed[Next] = true;
+        ++Count;
+        continue;
+      }
+      FlushRows();
+      auto Res = OldRows.find(Row.Char);
+      if (Res != OldRows.end()) {
+        auto& Old = OldTbl.Rows[Res->second];
+        auto RowShift = (int32_t) Row.Dc6Index - Old.Dc6Index;
+        if (TblRows::Same(Old, Row, RowShift)) {
+          First = Res->second;
+          Count = 1;
+          Shift = RowShift;
+          RowUsed[First] = true;
+          continue;
+        }
+      }
+      Append(Body, OpRow);
+      Append(Body, Row);
+      ++St.RowWritten;
+    }
+    FlushRows();
+    St.RowCopied = NewTbl.Rows.size() - St.RowWritten;
+    St.RowDropped = (size_t) count(RowUsed.begin(), RowUsed.end(), false);
+    return Body;
+  }
+
+  // Unchanged frames are copied from the old DC6 as they are, with NextBlock
+  // pointing past them in the new one
+  void ApplyBody(string_view Body, const Dc6Frames& OldSpr, const TblRows& OldTbl, string& Dc6, string& Tbl) {
+    BodyReader In(Body);
+    auto Hdr = In.Get<Dc6Header>();
+    auto NBlock = (uint64_t) Hdr.NDir * Hdr.NFrm;
+    if (NBlock > UINT32_MAX / sizeof(uint32_t))
+      Abort("Too many frames (%" PRIu64 ") in the patch", NBlock);
+    Dc6.clear();
+    Append(Dc6, Hdr);
+    auto FpOffs = Dc6.size();
+    Dc6.append(sizeof(uint32_t) * NBlock, '\0');
+    auto PutBlock = [&](uint64_t i, string_view Blk) {
+      auto Off = Cast<uint32_t>(Dc6.size(), "The new DC6 is too large (%zu bytes)", Dc6.size());
+      memcpy(Dc6.data() + FpOffs + sizeof(uint32_t) * i, &Off, sizeof(uint32_t));
+      auto Fp = Dc6.size();
+      Dc6.append(Blk);
+      auto Next = Cast<uint32_t>(Dc6.size(), "The new DC6 is too large (%zu bytes)", Dc6.size());
+      memcpy(Dc6.data() + Fp + offsetof(Dc6FrameHeader, NextBlock), &Next, sizeof(uint32_t));
+    };
+    for (auto i = uint64_t{0}; i < NBlock; ) {
+      auto Op = In.Get<uint8_t>();
+      if (Op == OpCopyFrames) {
+        auto First = In.Get<uint32_t>();
+        auto Count = In.Get<uint32_t>();
+        if ((uint64_t) First + Count > OldSpr.Blocks.size() || Count > NBlock - i)
+          Abort("Frames %u to %u are out of range (%zu)", First, First + Count, OldSpr.Blocks.size());
+        for (auto j = 0u; j < Count; ++j)
+          PutBlock(i++, OldSpr.Blocks[First + j]);
+      }
+      else if (Op == OpFrame) {
+        auto Frm = In.Get<Dc6FrameHeader>();
+        string Blk;
+        Append(Blk, Frm);
+        Blk.append(In.Bytes((size_t) Frm.Length + 3));
+        PutBlock(i++, Blk);
+      }
+      else
+        Abort("Unknown op (%u) among the frames of the patch", Op);
+    }
+    Dc6.append(In.Bytes(In.Get<uint32_t>()));
+
+    auto TblHdr = In.Get<TblHeader>();
+    Tbl.clear();
+    Append(Tbl, TblHdr);
+    for (auto i = 0u; i < TblHdr.NChar; ) {
+      auto Op = In.Get<uint8_t>();
+      if (Op == OpCopyRows) {
+        auto First = In.Get<uint32_t>();
+        auto Count = In.Get<uint32_t>();
+        auto Shift = In.Get<int32_t>();
+        if ((uint64_t) First + Count > OldTbl.Rows.size() || Count > TblHdr.NChar - i)
+          Abort("Rows %u to %u are out of range (%zu)", First, First + Count, OldTbl.Rows.size());
+        for (auto j = 0u; j < Count; ++j, ++i) {
+          auto Row = OldTbl.Rows[First + j];
+          Row.Dc6Index = (uint16_t) (Row.Dc6Index + Shift);
+          Append(Tbl, Row);
+        }
+      }
+      else if (Op == OpRow) {
+        Append(Tbl, In.Get<TblChar>());
+        ++i;
+      }
+      else
+        Abort("Unknown op (%u) among the rows of the patch", Op);
+    }
+    if (!In.AtEnd())
+      Abort("The patch has extra bytes after its rows");
+  }
+
+  uint64_t HashOf(const string& Data) {
+    return Fnv1a(Data.data(), Data.size());
+  }
+
+  void Diff(const char* OldDc6Path, const char* OldTblPath, const char* NewDc6Path, const char* NewTblPath, const char* PatchPath) {
+    auto OldDc6 = AutoFile(OldDc6Path, "rb").ReadAll();
+    auto OldTbl = AutoFile(OldTblPath, "rb").ReadAll();
+    auto NewDc6 = AutoFile(NewDc6Path, "rb").ReadAll();
+    auto NewTbl = AutoFile(NewTblPath, "rb").ReadAll();
+    Dc6Frames OldSpr, NewSpr;
+    TblRows OldRows, NewRows;
+    OldSpr.Parse(OldDc6);
+    OldRows.Parse(OldTbl);
+    NewSpr.Parse(NewDc6);
+    NewRows.Parse(NewTbl);
+    Stats St;
+    auto Body = MakeBody(OldSpr, OldRows, NewSpr, NewRows, St);
+    // Frames are laid out again one after another, which D2MFC does too
+    string Dc6, Tbl;
+    ApplyBody(Body, OldSpr, OldRows, Dc6, Tbl);
+    if (Dc6 != NewDc6)
+      Abort("%s does not have its frames one after another in order, it can't be patched", NewDc6Path);
+    Assert(Tbl == NewTbl);
+
+    PatchHeader Hdr;
+    Hdr.Sign = PatchSign;
+    Hdr.Version = PatchVer;
+    Hdr.OldDc6 = HashOf(OldDc6);
+    Hdr.OldTbl = HashOf(OldTbl);
+    Hdr.NewDc6 = HashOf(NewDc6);
+    Hdr.NewTbl = HashOf(NewTbl);
+    Hdr.BodySize = Cast<uint32_t>(Body.size(), "The patch is too large (%zu bytes)", Body.size());
+    Hdr.Unused = 0;
+    auto ZSize = compressBound((uLong) Body.size());
+    string Z(ZSize, '\0');
+    if (compress2((Bytef*) Z.data(), &ZSize, (const Bytef*) Body.data(), (uLong) Body.size(), Z_BEST_COMPRESSION) != Z_OK)
+      Abort("Failed to deflate the patch");
+    Z.resize(ZSize);
+    auto File = AutoFile(PatchPath, "wb");
+    File.Put(Hdr);
+    File.Put(Z.data(), Z.size());
+
+    auto Size = sizeof(PatchHeader) + Z.size();
+    printf("Frames: %zu copied, %zu written, %zu dropped\n", St.FrmCopied, St.FrmWritten, St.FrmDropped);
+    printf("Rows: %zu copied, %zu written, %zu dropped\n", St.RowCopied, St.RowWritten, St.RowDropped);
+    printf("Patch: %zu bytes, %.1f%% of the new files (%zu bytes)\n",
+      Size, 100.0 * Size / (NewDc6.size() + NewTbl.size()), NewDc6.size() + NewTbl.size());
+  }
+
+  void Apply(const char* OldDc6Path, const char* OldTblPath, const char* PatchPath, const char* NewDc6Path, const char* NewTblPath) {
+    auto OldDc6 = AutoFile(OldDc6Path, "rb").ReadAll();
+    auto OldTbl = AutoFile(OldTblPath, "rb").ReadAll();
+    auto Patch = AutoFile(PatchPath, "rb").ReadAll();
+    if (Patch.size() < sizeof(PatchHeader))
+      Abort("Patch file is too small (%zu bytes)", Patch.size());
+    PatchHeader Hdr;
+    memcpy(&Hdr, Patch.data(), sizeof(PatchHeader));
+    if (Hdr.Sign != PatchSign)
+      Abort("Patch file should start with %.8x instead of %.8x", PatchSign, Hdr.Sign);
+    if (Hdr.Version != PatchVer)
+      Abort("Patch version should be %u instead of %u", PatchVer, Hdr.Version);
+    if (Hdr.OldDc6 != HashOf(OldDc6) || Hdr.OldTbl != HashOf(OldTbl))
+      Abort("The patch is made for another version of %s and %s", OldDc6Path, OldTblPath);
+    string Body(Hdr.BodySize, '\0');
+    auto Size = (uLong) Body.size();
+    if (uncompress((Bytef*) Body.data(), &Size, (const Bytef*) Patch.data() + sizeof(PatchHeader), (uLong) (Patch.size() - sizeof(PatchHeader))) != Z_OK || Size != Body.size())
+      Abort("Failed to inflate the patch");
+    Dc6Frames OldSpr;
+    TblRows OldRows;
+    OldSpr.Parse(OldDc6);
+    OldRows.Parse(OldTbl);
+    string Dc6, Tbl;
+    ApplyBody(Body, OldSpr, OldRows, Dc6, Tbl);
+    if (Hdr.NewDc6 != HashOf(Dc6) || Hdr.NewTbl != HashOf(Tbl))
+      Abort("The patched files do not match the ones the patch is made from");
+    AutoFile(NewDc6Path, "wb").Put(Dc6.data(), Dc6.size());
+    AutoFile(NewTblPath, "wb").Put(Tbl.data(), Tbl.size());
+  }
+}
+
+int main(int NArg, char* Args[]) {
+  if (NArg != 7 || (strcmp(Args[1], "diff") && strcmp(Args[1], "apply"))) {
+    fprintf(stderr, "Incorrect command line.\n");
+    fprintf(stderr,
+      "\n"
+      "Patch Fonts\n"
+      "\n"
+      "Usage: %s diff <Old>.dc6 <Old>.tbl <New>.dc6 <New>.tbl <Out>.patch\n"
+      "       %s apply <Old>.dc6 <Old>.tbl <In>.patch <New>.dc6 <New>.tbl\n"
+      "Make a patch from the frames and rows that differ between two fonts, or\n"
+      "make the new font from the old one and a patch. Frames and rows the old\n"
+      "font has are copied from it, and are stored only as runs in the patch.\n",
+      Args[0], Args[0]
+    );
+    return EXIT_FAILURE;
+  }
+  if (!strcmp(Args[1], "diff"))
+    Diff(Args[2], Args[3], Args[4], Args[5], Args[6]);
+  else
+    Apply(Args[2], Args[3], Args[4], Args[5], Args[6]);
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -1,16 +1,17 @@
 #include "../Common/Common.hpp"
 #include "../Common/Bitmap.hpp"
+#include "../Common/Image.hpp"
 #include "../Common/Sprite.hpp"
 
 int main(int NArg, char* Args[]) {
-  if (NArg != 4) {
+  if (NArg != 4 && NArg != 5) {
     fprintf(stderr, "Incorrect command line.\n");
     fprintf(stderr,
       "\n"
       "Dump DC6 File\n"
       "\n"
-      "Usage: %s <Input>.dc6 <Palette>.dat <OutputDir>\n"
-      "Read DC6 file and extract all images.\n"
+      "Usage: %s <Input>.dc6 <Palette>.dat <OutputDir> [png|ppm|pgm|qoi]\n"
+      "Read DC6 file and extract all images, as palette PNG by default.\n"
       "Use null as the second argument to output grayscale images.\n",
       Args[0]
     );
@@ -21,9 +22,12 @@ int main(int NArg, char* Args[]) {
   Pal.ReadDat(Args[2]);
   printf("Done palette reading\n");
   printf("Reading DC6: %s...\n", Args[1]);
-  Sprite Spr;
-  Spr.ReadDc6(Args[1], Pal);
+  IdxSprite Spr;
+  Spr.ReadDc6(Args[1]);
   printf("Done DC6 reading\n");
+  auto Ext = NArg == 5 ? Args[4] : "png";
+  ImgOptions Opt;
+  Opt.Format = ParseImgFormat(Ext);
   printf("Saving extracted images...\n");
   for (auto Dir = 0u; Dir < Spr.NDir(); ++Dir)
     for (auto Frm = 0u; Frm < Spr.NFrm(); ++Frm) {
@@ -31,8 +35,8 @@ int main(int NArg, char* Args[]) {
       OutPath << Args[3];
       OutPath << '/' << setfill('0') << setw(2) << Dir;
       OutPath << '-' << setfill('0') << setw(4) << Frm;
-      OutPath << ".png";
-      Spr[Dir][Frm].SavePng(OutPath.str().c_str());
+      OutPath << '.' << Ext;
+      Spr[Dir][Frm].Save(OutPath.str().c_str(), Pal, Opt);
     }
   printf("Done image saving...\n");
   return 0;
@@ -0,0 +1,115 @@
+#include "../Common/Common.hpp"
+#include "../Common/AutoFile.hpp"
+#include "../Common/FontTable.hpp"
+
+#include <limits>
+
+namespace {
+  // UTF-16LE text, with an optional BOM
+  u16string ReadUtf16(const char* Path) {
+    auto Raw = AutoFile(Path, "rb").ReadAll();
+    if (Raw.size() % 2)
+      Abort("The size of %s (%zu) is odd, it should be UTF-16LE text", Path, Raw.size());
+    u16string Str(Raw.size() / 2, u'\0');
+    for (auto i = size_t{0}; i < Str.size(); ++i)
+      Str[i] = (char16_t) ((uint8_t) Raw[i * 2] | (uint8_t) Raw[i * 2 + 1] << 8);
+    if (!Str.empty() && Str[0] == 0xfeff)
+      Str.erase(0, 1);
+    return Str;
+  }
+
+  // The two chars \n in a string stand for a line break
+  void Unescape(u16string& Str) {
+    auto N = size_t{0};
+    for (auto i = size_t{0}; i < Str.size(); ++i)
+      if (Str[i] == u'\\' && i + 1 < Str.size() && Str[i + 1] == u'n') {
+        Str[N++] = u'\n';
+        ++i;
+      }
+      else
+        Str[N++] = Str[i];
+    Str.resize(N);
+  }
+
+  void PutUtf8(u16string_view Str) {
+    string Out;
+    for (auto i = size_t{0}; i < Str.size(); ++i) {
+      uint32_t Ch = Str[i];
+      if (Ch >= 0xd800 && Ch < 0xdc00 && i + 1 < Str.size() && Str[i + 1] >= 0xdc00 && Str[i + 1] < 0xe000)
+        Ch = 0x10000 + ((Ch - 0xd800) << 10) + (Str[++i] - 0xdc00);
+      if (Ch == u'\n')
+        Out += "\\n";
+      else if (Ch < 0x80)
+        Out += (char) Ch;
+      else if (Ch < 0x800) {
+        Out += (char) (0xc0 | Ch >> 6);
+        Out += (char) (0x80 | (Ch & 0x3f));
+      }
+      else if (Ch < 0x10000) {
+        Out += (char) (0xe0 | Ch >> 12);
+        Out += (char) (0x80 | (Ch >> 6 & 0x3f));
+        Out += (char) (0x80 | (Ch & 0x3f));
+      }
+      else {
+        Out += (char) (0xf0 | Ch >> 18);
+        Out += (char) (0x80 | (Ch >> 12 & 0x3f));
+        Out += (char) (0x80 | (Ch >> 6 & 0x3f));
+        Out += (char) (0x80 | (Ch & 0x3f));
+      }
+    }
+    fwrite(Out.data(), 1, Out.size(), stdout);
+  }
+}
+
+int main(int NArg, char* Args[]) {
+  if (NArg != 4 && NArg != 5) {
+    fprintf(stderr, "Incorrect command line.\n");
+    fprintf(stderr,
+      "\n"
+      "Check String Fit\n"
+      "\n"
+      "Usage: %s <Font>.tbl <Strings>.txt <MaxWidth> [MaxHeight]\n"
+      "Report the strings whose extents exceed MaxWidth (or MaxHeight) pixels.\n"
+      "Strings are read from UTF-16LE text, one per line; \\n stands for a line break.\n"
+      "Only TBL metrics are used, nothing is rendered.\n"
+      "Exit code is 0 if every string fits and 1 otherwise.\n",
+      Args[0]
+    );
+    return EXIT_FAILURE;
+  }
+  FontTable Tbl;
+  Tbl.ReadTbl(Args[1]);
+  auto Met = make_unique<TblMetrics>();
+  Met->FromTbl(Tbl);
+  auto MaxW = Parse<uint32_t>(Args[3], "MaxWidth");
+  auto MaxH = NArg == 5 ? Parse<uint32_t>(Args[4], "MaxHeight") : numeric_limits<uint32_t>::max();
+  auto Text = ReadUtf16(Args[2]);
+  auto NLine = size_t{0}, NOver = size_t{0}, NMissing = size_t{0};
+  u16string Str;
+  for (auto Pos = size_t{0}; Pos < Text.size(); ) {
+    auto End = Text.find(u'\n', Pos);
+    if (End == Text.npos)
+      End = Text.size();
+    Str.assign(Text, Pos, End - Pos);
+    Pos = End + 1;
+    ++NLine;
+    if (!Str.empty() && Str.back() == u'\r')
+      Str.pop_back();
+    Unescape(Str);
+    auto Missing = size_t{0};
+    auto [W, H] = Met->Extent(Str, Missing);
+    NMissing += Missing;
+    if (W <= MaxW && H <= MaxH && !Missing)
+      continue;
+    printf("%zu: %ux%u", NLine, W, H);
+    if (Missing)
+      printf(" (%zu missing chars)", Missing);
+    if (W > MaxW || H > MaxH)
+      ++NOver;
+    printf(" ");
+    PutUtf8(Str);
+    putchar('\n');
+  }
+  printf("%zu strings, %zu too large, %zu missing chars\n", NLine, NOver, NMissing);
+  return NOver ? EXIT_FAILURE : EXIT_SUCCESS;
+}
\ No newline at end of file
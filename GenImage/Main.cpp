@@ -1,4 +1,5 @@
 #include "../Common/Common.hpp"
+#include "../Common/Diag.hpp"
 #include "../Common/Font.hpp"
 
 int main() {
@@ -21,15 +22,17 @@ int main() {
   }
   printf("Rendering glyphs...\n");
   Fnt.RenderGlyphs();
+  Diags().Print();
   printf("Reading palette...\n");
   Palette Pal;
   Pal.ReadDat("pal.dat");
+  CovRamps Ramps(Pal);
   printf("Dumping font...\n");
-  Sprite Spr;
+  CovSprite Spr;
   FontTable Tbl;
-  Fnt.Dump(Spr, Tbl);
+  Fnt.Dump(Spr, Tbl, Ramps);
   printf("Saving DC6...\n");
-  Spr.SaveDc6("x.DC6", Pal);
+  Spr.SaveDc6("x.DC6", Ramps);
   printf("Saving TBL...\n");
   Tbl.SaveTbl("x.tbl");
 #if 1
@@ -41,7 +44,7 @@ int main() {
       OutPath << '/' << setfill('0') << setw(2) << Dir;
       OutPath << '-' << setfill('0') << setw(4) << Frm;
       OutPath << ".png";
-      Spr[Dir][Frm].SavePng(OutPath.str().c_str());
+      Spr[Dir][Frm].Save(OutPath.str().c_str());
     }
 #endif
   printf("All done\n");
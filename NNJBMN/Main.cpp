@@ -4,8 +4,8 @@
 int main() {
   Bitmap Bmp(1, 1);
   Bmp.Fill(0xffffff);
-  Bmp.SavePng("white.png");
+  Bmp.Save("white.png");
   Bmp.Fill(0x8080ff);
-  Bmp.SavePng("normal.png");
+  Bmp.Save("normal.png");
   return 0;
 }
\ No newline at end of file
@@ -1,37 +1,52 @@
 #include "../Common/Common.hpp"
 #include "../Common/Bitmap.hpp"
+#include "../Common/Config.hpp"
+#include "../Common/Diag.hpp"
 #include "../Common/Font.hpp"
 #include "../Common/FontTable.hpp"
 #include "../Common/Sprite.hpp"
 
 int main(int NArg, char* Args[]) {
-  if (NArg != 5) {
+  if (NArg != 3 && NArg != 5) {
     fprintf(stderr, "Incorrect command line.\n");
     fprintf(stderr,
       "\n"
       "Dump DC6 File\n"
       "\n"
-      "Usage: %s <Input>.dc6 <Input>.tbl <Palette>.dat <Output>.png\n"
-      "Render text using provided dc6 and tbl.\n"
+      "Usage: %s <Input>.dc6 <Input>.tbl <Palette>.dat <Output>\n"
+      "       %s <Config>.json <Output>\n"
+      "Render text using provided dc6 and tbl, or straight from the font face\n"
+      "of a D2MFC config, in which case only the glyphs in the text are rendered.\n"
+      "The output is PNG, PPM, PGM or QOI by its extension, PNG without one.\n"
       "Text should be given in standard input.\n",
-      Args[0]
+      Args[0], Args[0]
     );
     return EXIT_FAILURE;
   }
-  printf("Reading palette...\n");
-  Palette Pal;
-  Pal.ReadDat(Args[3]);
-  printf("Reading DC6...\n");
-  Sprite Spr;
-  Spr.ReadDc6(Args[1], Pal);
-  printf("Reading TBL...\n");
-  FontTable Tbl;
-  Tbl.ReadTbl(Args[2]);
-  printf("LnSpacing=%u\n", Tbl.Hdr.LnSpacing);
-  printf("CapHeight=%u\n", Tbl.Hdr.CapHeight);
-  printf("Constructing font...\n");
   Font Fnt;
-  Fnt.FromSprTbl(Spr, Tbl);
+  LazySprite Spr;
+  Palette Pal;
+  if (NArg == 3) {
+    printf("Reading config...\n");
+    FontConfig Cfg;
+    if (!Cfg.Read(Args[1], Fnt))
+      Abort("%s is not a D2MFC config", Args[1]);
+    printf("Computing metrics...\n");
+    Fnt.DeferGlyphs();
+  }
+  else {
+    printf("Reading palette...\n");
+    Pal.ReadDat(Args[3]);
+    printf("Reading DC6...\n");
+    Spr.Open(Args[1], Pal);
+    printf("Reading TBL...\n");
+    FontTable Tbl;
+    Tbl.ReadTbl(Args[2]);
+    printf("Constructing font...\n");
+    Fnt.FromSprTbl(Spr, Tbl);
+  }
+  printf("LnSpacing=%u\n", Fnt.LnSpacing);
+  printf("CapHeight=%u\n", Fnt.CapHeight);
   wstring Str;
   printf("Ready, type some text below:\n");
   auto Ch = (wchar_t) getwchar();
@@ -41,9 +56,22 @@ int main(int NArg, char* Args[]) {
   }
   while (!Str.empty() && Str.back() == '\n')
     Str.pop_back();
-  auto Bmp = Fnt.Render(Str);
-  printf("Saving PNG...\n");
-  Bmp.SavePng(Args[4]);
+  if (NArg == 3) {
+    auto Cov = Fnt.Render(Str);
+    Diags().Print();
+    printf("Saving image...\n");
+    Cov.Save(Args[NArg - 1]);
+  }
+  else {
+    // Frames keep their palette indices, so the colors of the DC6 show
+    auto [W, H] = Fnt.Extent(Str);
+    IdxBitmap Img(W, H);
+    Img.Fill({0, 0});
+    Fnt.Layout(Str, H, [&](const FontGlyph& G, int32_t X, int32_t Y) { Img.Draw(Spr.IdxFrame(0, G.Dc6Index), X, Y); });
+    Diags().Print();
+    printf("Saving image...\n");
+    Img.Save(Args[NArg - 1], Pal);
+  }
   printf("All done\n");
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "../Common/Common.hpp"
+#include "../Common/Config.hpp"
+#include "../Common/Font.hpp"
+
+#include <chrono>
+
+namespace {
+  constexpr size_t MaxOutliers = 8;
+
+  // Min, median, 95th percentile and max
+  struct Spread {
+    array<int32_t, 4> Val{};
+    bool Any{};
+
+    explicit Spread(vector<int32_t> V) {
+      if (V.empty())
+        return;
+      sort(V.begin(), V.end());
+      Val = {V.front(), V[(V.size() - 1) / 2], V[(V.size() - 1) * 95 / 100], V.back()};
+      Any = true;
+    }
+
+    void Print() const {
+      if (Any)
+        printf("  %4d %4d %4d %4d", Val[0], Val[1], Val[2], Val[3]);
+      else
+        printf("  %4s %4s %4s %4s", "-", "-", "-", "-");
+    }
+  };
+
+  // Glyphs above the upper Tukey fence of all the glyphs, highest first
+  template<class Fn>
+  void PrintOutliers(const char* Name, const vector<const GlyphMetrics*>& Ms, Fn&& Value) {
+    vector<int32_t> V;
+    for (auto M : Ms)
+      V.emplace_back(Value(*M));
+    if (V.size() < 4)
+      return;
+    sort(V.begin(), V.end());
+    auto Q1 = V[V.size() / 4];
+    auto Q3 = V[V.size() * 3 / 4];
+    auto Fence = Q3 + (Q3 - Q1) * 3 / 2;
+    vector<const GlyphMetrics*> Out;
+    for (auto M : Ms)
+      if (Value(*M) > Fence)
+        Out.emplace_back(M);
+    if (Out.empty())
+      return;
+    stable_sort(Out.begin(), Out.end(), [&](auto A, auto B) { return Value(*A) > Value(*B); });
+    printf("%s above %d:", Name, Fence);
+    for (auto i = size_t{0}; i < Out.size() && i < MaxOutliers; ++i)
+      printf(" U+%04X (%d)", Out[i]->Char, Value(*Out[i]));
+    if (Out.size() > MaxOutliers)
+      printf(" and %zu more", Out.size() - MaxOutliers);
+    putchar('\n');
+  }
+
+  void Analyze(const FontConfig& Cfg, const Font& Fnt, const vector<int32_t>& Factors) {
+    auto T0 = chrono::steady_clock::now();
+    auto Ms = Fnt.MeasureGlyphs(Cfg.NThread);
+    auto Elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - T0).count();
+    vector<const GlyphMetrics*> Drawn;
+    auto NMissing = size_t{0};
+    for (auto& M : Ms)
+      if (!M.Found)
+        ++NMissing;
+      else if (M.W && M.H)
+        Drawn.emplace_back(&M);
+    printf("Size %u: %zu glyphs measured in %.0f ms, %zu not in the face, %zu empty\n",
+      Fnt.Size, Ms.size(), Elapsed, NMissing, Ms.size() - NMissing - Drawn.size());
+
+    printf("%-24s %6s  %-19s  %-19s\n", "Range", "Glyphs", "Ascent min/med/p95/max", "Descent min/med/p95/max");
+    for (auto& R : Cfg.Ranges) {
+      vector<int32_t> Asc, Desc;
+      auto N = size_t{0};
+      for (auto& M : Ms)
+        if (M.Char >= R.First && M.Char <= R.Last) {
+          ++N;
+          if (M.W && M.H) {
+            Asc.emplace_back(M.Top);
+            Desc.emplace_back(M.Descent());
+          }
+        }
+      char Name[64];
+      snprintf(Name, sizeof(Name), "%u-%u %s", R.First, R.Last, R.Note.c_str());
+      printf("%-24.24s %6zu", Name, N);
+      Spread(move(Asc)).Print();
+      Spread(move(Desc)).Print();
+      putchar('\n');
+    }
+    PrintOutliers("Ascents", Drawn, [](const GlyphMetrics& M) { return M.Top; });
+    PrintOutliers("Descents", Drawn, [](const GlyphMetrics& M) { return M.Descent(); });
+
+    // As PlanGlyphs pads the bitmaps
+    auto MaxDescent = int32_t{};
+    for (auto M : Drawn)
+      MaxDescent = max(MaxDescent, M->Descent());
+    auto Padding = Fnt.PaddedDescent(MaxDescent);
+    auto MaxH = size_t{};
+    for (auto M : Drawn)
+      if (M->Top + Padding > 0)
+        MaxH = max(MaxH, (size_t) (M->Top + Padding));
+    printf("MaxDescent %d, padded to %d, MaxH %zu\n", MaxDescent, Padding, MaxH);
+    printf("%13s %9s %13s\n", "leadingfactor", "LnSpacing", "ActualSpacing");
+    for (auto Factor : Factors) {
+      auto LnSpacing = Fnt.LnSpacing ? Fnt.LnSpacing : Font::LineSpacing(MaxH, MaxDescent, Factor, Fnt.LnSpacingOff);
+      auto Actual = Font::ActualSpacing(LnSpacing, Factor);
+      printf("%13d %9u %13u%s%s\n", Factor, LnSpacing, Actual,
+        Actual < MaxH ? "  (less than MaxH)" : "", Factor == Fnt.HeightConstant ? "  (configured)" : "");
+    }
+  }
+}
+
+int main(int NArg, char* Args[]) {
+  if (NArg < 2) {
+    fprintf(stderr, "Incorrect command line.\n");
+    fprintf(stderr,
+      "\n"
+      "Analyze Vertical Metrics\n"
+      "\n"
+      "Usage: %s <Config>.json [leadingfactor ...]\n"
+      "Report the ascents and descents of the glyphs of each range of a D2MFC\n"
+      "config, and the line spacing D2MFC would set for each leadingfactor\n"
+      "(the configured one, 14, 15 and 17 by default). Glyphs are loaded for\n"
+      "their metrics only, nothing is rasterized.\n",
+      Args[0]
+    );
+    return EXIT_FAILURE;
+  }
+  vector<FontConfig> Cfgs;
+  vector<unique_ptr<Font>> Fnts;
+  if (!ReadFamily(Args[1], Cfgs, Fnts))
+    Abort("%s is not a D2MFC config", Args[1]);
+  for (auto i = size_t{0}; i < Cfgs.size(); ++i) {
+    vector<int32_t> Factors;
+    for (auto j = 2; j < NArg; ++j)
+      Factors.emplace_back(Parse<int32_t>(Args[j], "leadingfactor"));
+    if (Factors.empty())
+      Factors = {Fnts[i]->HeightConstant, 14, 15, 17};
+    for (auto Factor : Factors)
+      if (Factor <= 0)
+        Abort("The leadingfactor should be positive instead of %d", Factor);
+    sort(Factors.begin(), Factors.end());
+    Factors.erase(unique(Factors.begin(), Factors.end()), Factors.end());
+    if (i)
+      putchar('\n');
+    Analyze(Cfgs[i], *Fnts[i], Factors);
+  }
+  return EXIT_SUCCESS;
+}
\ No newline at end of file